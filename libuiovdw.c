@@ -0,0 +1,504 @@
+/*
+ * libuiovdw.c
+ *
+ * Userspace access library for uio_vdw instances
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+
+#include "libuiovdw.h"
+
+#define UIODEV "/dev/uio"
+#define UIOCLASS "/sys/class/uio"
+#define HUGE_SIZE (2UL * 1024 * 1024)
+#define NAME_SIZE 64
+
+struct _vdw_dev {
+	int fd;
+	int uionr;
+};
+
+typedef struct _vdw_entry {
+	int uionr;
+	char name[NAME_SIZE];
+} vdw_entry;
+
+/* discovery cache: entries sorted by uio number and an open addressing
+ * hash of the names pointing into it
+ */
+static struct {
+	vdw_entry *entries;
+	int count;
+	int *hash; // index + 1 into entries, 0 is empty
+	unsigned int hashsize; // power of 2
+	int scanned;
+} cache;
+
+static unsigned int namehash(const char *name) {
+	unsigned int hash = 2166136261u; // FNV-1a
+	while (*name) {
+		hash = (hash ^ (unsigned char) *name++) * 16777619u;
+	}
+	return hash;
+}
+
+static int entrycompare(const void *a, const void *b) {
+	return ((const vdw_entry*) a)->uionr - ((const vdw_entry*) b)->uionr;
+}
+
+/* read a small sysfs file relative to dirfd as is, all of its lines */
+static int readallat(int dirfd, const char *path, char *buf, size_t size) {
+	ssize_t r;
+	int fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	r = read(fd, buf, size - 1);
+	close(fd);
+	if (r < 0) {
+		return -1;
+	}
+	buf[r] = 0;
+	return (int) r;
+}
+
+/* read a small sysfs file relative to dirfd, strips the newline */
+static int readat(int dirfd, const char *path, char *buf, size_t size) {
+	int r = readallat(dirfd, path, buf, size);
+	if (r >= 0) {
+		buf[strcspn(buf, "\n")] = 0;
+	}
+	return r;
+}
+
+int vdw_discover(void) {
+	DIR *dir;
+	struct dirent *dent;
+	int capacity = 0;
+	int uionr;
+	vdw_entry *entries = 0;
+	int count = 0;
+
+	dir = opendir(UIOCLASS);
+	if (!dir) {
+		return -1;
+	}
+	while ((dent = readdir(dir))) {
+		char path[sizeof(dent->d_name) + 8];
+		if (sscanf(dent->d_name, "uio%d", &uionr) != 1) {
+			continue;
+		}
+		if (count == capacity) {
+			vdw_entry *grown;
+			capacity = capacity ? capacity * 2 : 16;
+			grown = realloc(entries, capacity * sizeof(*entries));
+			if (!grown) {
+				free(entries);
+				closedir(dir);
+				return -1;
+			}
+			entries = grown;
+		}
+		snprintf(path, sizeof(path), "%s/name", dent->d_name);
+		if (readat(dirfd(dir), path, entries[count].name, NAME_SIZE) < 0) {
+			continue;
+		}
+		entries[count].uionr = uionr;
+		++count;
+	}
+	closedir(dir);
+	qsort(entries, count, sizeof(*entries), entrycompare);
+
+	free(cache.entries);
+	free(cache.hash);
+	cache.entries = entries;
+	cache.count = count;
+	cache.hashsize = 16;
+	while (cache.hashsize < 2u * count) {
+		cache.hashsize *= 2;
+	}
+	cache.hash = calloc(cache.hashsize, sizeof(*cache.hash));
+	if (!cache.hash) {
+		cache.hashsize = 0;
+		return -1;
+	}
+	for (int iter = 0; iter < count; iter++) {
+		unsigned int slot = namehash(entries[iter].name) & (cache.hashsize - 1);
+		while (cache.hash[slot]) {
+			slot = (slot + 1) & (cache.hashsize - 1);
+		}
+		cache.hash[slot] = iter + 1;
+	}
+	cache.scanned = 1;
+	return count;
+}
+
+static int ensurescanned(void) {
+	return (cache.scanned || vdw_discover() >= 0) ? 0 : -1;
+}
+
+int vdw_find(const char *name) {
+	unsigned int slot;
+	if (ensurescanned() || !cache.hashsize) {
+		return -1;
+	}
+	slot = namehash(name) & (cache.hashsize - 1);
+	while (cache.hash[slot]) {
+		const vdw_entry *entry = &cache.entries[cache.hash[slot] - 1];
+		if (!strcmp(entry->name, name)) {
+			return entry->uionr;
+		}
+		slot = (slot + 1) & (cache.hashsize - 1);
+	}
+	return -1;
+}
+
+int vdw_find_nth(const char *prefix, int nth) {
+	size_t prefixlen;
+	if (ensurescanned()) {
+		return -1;
+	}
+	prefix = prefix ? prefix : VDW_DEVICE_NAME;
+	prefixlen = strlen(prefix);
+	for (int iter = 0; iter < cache.count; iter++) {
+		if (!strncmp(cache.entries[iter].name, prefix, prefixlen) && nth-- == 0) {
+			return cache.entries[iter].uionr;
+		}
+	}
+	return -1;
+}
+
+const char* vdw_name(int uionr) {
+	int low = 0, high;
+	if (ensurescanned()) {
+		return 0;
+	}
+	high = cache.count - 1;
+	while (low <= high) {
+		int mid = (low + high) / 2;
+		if (cache.entries[mid].uionr == uionr) {
+			return cache.entries[mid].name;
+		}
+		if (cache.entries[mid].uionr < uionr) {
+			low = mid + 1;
+		} else {
+			high = mid - 1;
+		}
+	}
+	return 0;
+}
+
+vdw_dev* vdw_open(int uionr) {
+	char fname[32];
+	vdw_dev *dev = malloc(sizeof(*dev));
+	if (!dev) {
+		return 0;
+	}
+	snprintf(fname, sizeof(fname), "%s%d", UIODEV, uionr);
+	dev->fd = open(fname, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (dev->fd < 0) {
+		free(dev);
+		return 0;
+	}
+	dev->uionr = uionr;
+	return dev;
+}
+
+vdw_dev* vdw_open_name(const char *name) {
+	int uionr = vdw_find(name);
+	if (uionr < 0) {
+		errno = ENODEV;
+		return 0;
+	}
+	return vdw_open(uionr);
+}
+
+void vdw_close(vdw_dev *dev) {
+	if (dev) {
+		close(dev->fd);
+		free(dev);
+	}
+}
+
+int vdw_fd(const vdw_dev *dev) {
+	return dev->fd;
+}
+
+int vdw_uionr(const vdw_dev *dev) {
+	return dev->uionr;
+}
+
+/* mmap uio map "index" with protection prot */
+static int mapregion(vdw_dev *dev, int index, int prot, vdw_map *map) {
+	char path[96];
+	char value[32];
+	size_t size;
+	uint8_t *reserve, *aligned;
+	void *mapped;
+
+	snprintf(path, sizeof(path), UIOCLASS "/uio%d/maps/map%d/size",
+			dev->uionr, index);
+	if (readat(AT_FDCWD, path, value, sizeof(value)) < 0) {
+		return -1;
+	}
+	size = strtoul(value, NULL, 16);
+	if (!size) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* large maps go to a 2 MB aligned address so the driver can back
+	 * them with PMD pages ("contig" backend)
+	 */
+	if (size < HUGE_SIZE) {
+		mapped = mmap(0, size, prot, MAP_SHARED, dev->fd,
+				index * sysconf(_SC_PAGESIZE));
+	} else {
+		reserve = mmap(0, size + HUGE_SIZE, PROT_NONE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (reserve == MAP_FAILED) {
+			return -1;
+		}
+		aligned = (uint8_t*) (((uintptr_t) reserve + HUGE_SIZE - 1)
+				& ~(HUGE_SIZE - 1));
+		mapped = mmap(aligned, size, prot, MAP_SHARED | MAP_FIXED, dev->fd,
+				index * sysconf(_SC_PAGESIZE));
+		if (mapped == MAP_FAILED) {
+			munmap(reserve, size + HUGE_SIZE);
+		} else {
+			if (aligned > reserve) {
+				munmap(reserve, aligned - reserve);
+			}
+			if (reserve + HUGE_SIZE > aligned) {
+				munmap(aligned + size, reserve + HUGE_SIZE - aligned);
+			}
+		}
+	}
+	if (mapped == MAP_FAILED) {
+		return -1;
+	}
+	map->base = mapped;
+	map->size = size;
+	map->index = index;
+	return 0;
+}
+
+int vdw_map_region(vdw_dev *dev, int index, vdw_map *map) {
+	return mapregion(dev, index, PROT_READ | PROT_WRITE, map);
+}
+
+int vdw_map_readonly(vdw_dev *dev, int index, vdw_map *map) {
+	return mapregion(dev, index, PROT_READ, map);
+}
+
+int vdw_map_window(vdw_dev *dev, int window, vdw_map *map) {
+	char path[96];
+	char name[NAME_SIZE];
+	char suffix[16];
+	size_t namelen, suffixlen;
+
+	snprintf(suffix, sizeof(suffix), "_win%d", window);
+	suffixlen = strlen(suffix);
+	for (int index = VDW_EVENTRING_MAP + 1; index < VDW_MAX_MAPS; index++) {
+		snprintf(path, sizeof(path), UIOCLASS "/uio%d/maps/map%d/name",
+				dev->uionr, index);
+		if (readat(AT_FDCWD, path, name, sizeof(name)) < 0) {
+			break;
+		}
+		namelen = strlen(name);
+		if (namelen >= suffixlen && !strcmp(name + namelen - suffixlen, suffix)) {
+			return vdw_map_region(dev, index, map);
+		}
+	}
+	errno = ENOENT;
+	return -1;
+}
+
+int vdw_lines(const vdw_dev *dev) {
+	char path[128];
+	char value[VDW_MAX_LINES * 32];
+	int lines = 0;
+
+	snprintf(path, sizeof(path), UIOCLASS "/uio%d/device/lines", dev->uionr);
+	if (readallat(AT_FDCWD, path, value, sizeof(value)) < 0) {
+		return -1;
+	}
+	for (const char *iter = value; *iter; iter++) {
+		lines += *iter == '\n'; // "<irq> <count>\n" per line
+	}
+	return lines;
+}
+
+void vdw_unmap(vdw_map *map) {
+	if (map->base) {
+		munmap((void*) map->base, map->size);
+		map->base = 0;
+		map->size = 0;
+	}
+}
+
+int vdw_attr_read(const vdw_dev *dev, const char *attr, char *buf, size_t size) {
+	char path[128];
+	snprintf(path, sizeof(path), UIOCLASS "/uio%d/device/%s", dev->uionr, attr);
+	return readat(AT_FDCWD, path, buf, size);
+}
+
+int vdw_attr_write(const vdw_dev *dev, const char *attr, const char *value) {
+	char path[128];
+	ssize_t w;
+	int fd;
+	snprintf(path, sizeof(path), UIOCLASS "/uio%d/device/%s", dev->uionr, attr);
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	w = write(fd, value, strlen(value));
+	close(fd);
+	return w < 0 ? -1 : 0;
+}
+
+int vdw_id(const vdw_dev *dev) {
+	char value[16];
+	if (vdw_attr_read(dev, "id", value, sizeof(value)) < 0) {
+		return -1;
+	}
+	return (int) strtol(value, NULL, 10);
+}
+
+int vdw_export_dmabuf(const vdw_dev *dev, int flags) {
+	vdw_dmabuf_export req = { 0 };
+	int ctlfd, ret;
+	int id = vdw_id(dev);
+
+	if (id < 0) {
+		return -1;
+	}
+	ctlfd = open(VDW_CTL_DEVICE, O_RDWR | O_CLOEXEC);
+	if (ctlfd < 0) {
+		return -1;
+	}
+	req.id = (uint32_t) id;
+	req.flags = (uint32_t) flags;
+	ret = ioctl(ctlfd, VDW_IOC_EXPORT_DMABUF, &req);
+	close(ctlfd);
+	return ret < 0 ? -1 : req.fd;
+}
+
+static int eventfdctl(const vdw_dev *dev, int efd, uint32_t mask,
+		uint32_t lines, uint32_t flags) {
+	vdw_eventfd_assign req = { 0 };
+	int ctlfd, ret;
+	int id = vdw_id(dev);
+
+	if (id < 0) {
+		return -1;
+	}
+	ctlfd = open(VDW_CTL_DEVICE, O_RDWR | O_CLOEXEC);
+	if (ctlfd < 0) {
+		return -1;
+	}
+	req.id = (uint32_t) id;
+	req.fd = efd;
+	req.mask = mask;
+	req.lines = lines;
+	req.flags = flags;
+	ret = ioctl(ctlfd, VDW_IOC_EVENTFD, &req);
+	close(ctlfd);
+	return ret < 0 ? -1 : 0;
+}
+
+int vdw_eventfd(const vdw_dev *dev, uint32_t mask, uint32_t lines) {
+	int efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (efd < 0) {
+		return -1;
+	}
+	if (eventfdctl(dev, efd, mask, lines, 0)) {
+		int saved = errno;
+		close(efd);
+		errno = saved;
+		return -1;
+	}
+	return efd;
+}
+
+int vdw_eventfd_close(const vdw_dev *dev, int efd) {
+	int ret = eventfdctl(dev, efd, 0, 0, VDW_EVENTFD_DEASSIGN);
+	close(efd);
+	return ret;
+}
+
+int vdw_pin_local(const vdw_dev *dev) {
+	char list[1024];
+	char *range, *rest;
+	cpu_set_t set;
+
+	if (vdw_attr_read(dev, "local_cpus", list, sizeof(list)) < 0) {
+		return -1;
+	}
+	CPU_ZERO(&set);
+	rest = list;
+	while ((range = strsep(&rest, ","))) { // "0-3,8,10-11"
+		int first, last;
+		int n = sscanf(range, "%d-%d", &first, &last);
+		if (n < 1) {
+			continue;
+		}
+		if (n == 1) {
+			last = first;
+		}
+		for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+			CPU_SET(cpu, &set);
+		}
+	}
+	if (!CPU_COUNT(&set)) {
+		errno = EINVAL;
+		return -1;
+	}
+	return sched_setaffinity(0, sizeof(set), &set);
+}
+
+int vdw_irq_enable(vdw_dev *dev, int enable) {
+	uint32_t info = enable ? 1 : 0;
+	return write(dev->fd, &info, sizeof(info)) == (ssize_t) sizeof(info) ? 0 : -1;
+}
+
+int vdw_event_try(vdw_dev *dev, uint32_t *count) {
+	uint32_t info;
+	ssize_t nb = read(dev->fd, &info, sizeof(info));
+	if (nb == (ssize_t) sizeof(info)) {
+		if (count) {
+			*count = info;
+		}
+		return 1;
+	}
+	if (nb < 0 && errno == EAGAIN) {
+		return 0;
+	}
+	return -1;
+}
+
+int vdw_event_wait(vdw_dev *dev, uint32_t *count, int timeoutms) {
+	struct pollfd fds = { .fd = dev->fd, .events = POLLIN, };
+	int ret = poll(&fds, 1, timeoutms);
+	if (ret < 0) {
+		return -1;
+	}
+	if (ret == 0) {
+		return 0;
+	}
+	return vdw_event_try(dev, count);
+}
@@ -0,0 +1,221 @@
+/*
+ * libuiovdw.h
+ *
+ * Userspace access library for uio_vdw instances: cached discovery,
+ * mapping handles, register accessors and non-blocking event waits
+ */
+#ifndef LIBUIOVDW_H
+#define LIBUIOVDW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "uio_vdw.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VDW_DEVICE_NAME "uio_vdw_device"
+#define VDW_MAX_MAPS 5 // MAX_UIO_MAPS
+#define VDW_MAX_LINES 8 // interrupt lines per instance
+
+typedef struct _vdw_dev vdw_dev;
+
+/* one mmapped uio map, base is 2 MB aligned for maps of 2 MB and more */
+typedef struct _vdw_map {
+	volatile void *base;
+	size_t size;
+	int index;
+} vdw_map;
+
+/*! scan /sys/class/uio once and (re)build the name index
+ * only needed again after instances were added or removed, the lookup
+ * functions call it themselves when nothing was scanned yet
+ * @return number of uio devices found, -1 on error
+ */
+int vdw_discover(void);
+
+/*! uio number of the device called name, -1 if there is none */
+int vdw_find(const char *name);
+
+/*! uio number of the n-th device whose name starts with prefix (NULL for
+ * VDW_DEVICE_NAME), in uio number order, -1 if there are fewer
+ */
+int vdw_find_nth(const char *prefix, int nth);
+
+/*! name of /dev/uio<uionr> as found by discovery, NULL if unknown */
+const char* vdw_name(int uionr);
+
+/*! open /dev/uio<uionr> non-blocking, ready for poll/epoll
+ * @return handle, NULL with errno set on error
+ */
+vdw_dev* vdw_open(int uionr);
+
+/*! open the device called name, see vdw_find() */
+vdw_dev* vdw_open_name(const char *name);
+
+void vdw_close(vdw_dev *dev);
+
+/*! file descriptor, readable when an event is pending */
+int vdw_fd(const vdw_dev *dev);
+
+int vdw_uionr(const vdw_dev *dev);
+
+/*! mmap uio map "index" of the device
+ * @return 0, -1 with errno set on error
+ */
+int vdw_map_region(vdw_dev *dev, int index, vdw_map *map);
+
+/*! mmap uio map "index" read-only, the driver refuses writable mappings
+ * of the event ring and the snapshot page
+ * @return 0, -1 with errno set on error
+ */
+int vdw_map_readonly(vdw_dev *dev, int index, vdw_map *map);
+
+/*! the interrupt event ring, see uio_vdw.h */
+static inline int vdw_map_events(vdw_dev *dev, vdw_map *map) {
+	return vdw_map_readonly(dev, VDW_EVENTRING_MAP, map);
+}
+
+/*! device memory window "window" (1 based) of the instance, "maps=" */
+int vdw_map_window(vdw_dev *dev, int window, vdw_map *map);
+
+/*! the register snapshot page, instances with "snapshot=" only */
+static inline int vdw_map_snapshot(vdw_dev *dev, vdw_map *map) {
+	return vdw_map_readonly(dev, VDW_SNAPSHOT_MAP, map);
+}
+
+void vdw_unmap(vdw_map *map);
+
+/*! read a sysfs attribute of the instance, /sys/class/uio/uioX/device/<attr>,
+ * buf holds its first line only
+ * @return length read, -1 on error
+ */
+int vdw_attr_read(const vdw_dev *dev, const char *attr, char *buf, size_t size);
+
+/*! write a sysfs attribute of the instance
+ * @return 0, -1 on error
+ */
+int vdw_attr_write(const vdw_dev *dev, const char *attr, const char *value);
+
+/*! registry id of the instance, as used by the /dev/uio_vdw ioctls
+ * @return id, -1 on error
+ */
+int vdw_id(const vdw_dev *dev);
+
+/*! export the instance memory as dma-buf, flags as for open(), only
+ * O_CLOEXEC and the access mode are used
+ * @return dma-buf fd, -1 with errno set on error
+ */
+int vdw_export_dmabuf(const vdw_dev *dev, int flags);
+
+/*! new non-blocking eventfd signalled by the driver for the events of
+ * the instance whose "cause=" register has one of the mask bits set, or
+ * for every event with mask 0, and that came in on one of the lines
+ * (bit n: line n, 0: any); read() returns the events since the last
+ * read, independent of /dev/uioX and of the other eventfds
+ * @return eventfd, -1 with errno set on error
+ */
+int vdw_eventfd(const vdw_dev *dev, uint32_t mask, uint32_t lines);
+
+/*! number of interrupt lines of the instance, see its "lines" attribute
+ * @return lines, -1 on error
+ */
+int vdw_lines(const vdw_dev *dev);
+
+/*! unregister an eventfd from vdw_eventfd() and close it
+ * @return 0, -1 with errno set when the driver did not know it
+ */
+int vdw_eventfd_close(const vdw_dev *dev, int efd);
+
+/*! pin the calling thread to the cpus of the instance node (its
+ * local_cpus attribute), next to its buffer and interrupt
+ * @return 0, -1 with errno set on error
+ */
+int vdw_pin_local(const vdw_dev *dev);
+
+/*! unmask (1) or mask (0) the interrupt line, see irqcontrol */
+int vdw_irq_enable(vdw_dev *dev, int enable);
+
+/*! consume a pending event without blocking
+ * @return 1 and the total event count in *count, 0 when nothing is
+ * pending, -1 on error
+ */
+int vdw_event_try(vdw_dev *dev, uint32_t *count);
+
+/*! wait up to timeoutms (-1: forever) for an event, then consume it
+ * @return as vdw_event_try()
+ */
+int vdw_event_wait(vdw_dev *dev, uint32_t *count, int timeoutms);
+
+/* event handler plugin of uio_vdw_daemon (-H), a shared object that
+ * exports VDW_HANDLER_EVENT and optionally VDW_HANDLER_INIT/EXIT; it is
+ * called on the daemon thread, pinned and locked, once per ring event
+ * init: set up *ctx, non-zero refuses to start
+ * event: map is the instance region, non-zero counts as handler error
+ */
+#define VDW_HANDLER_INIT "vdw_handler_init"
+#define VDW_HANDLER_EVENT "vdw_handler_event"
+#define VDW_HANDLER_EXIT "vdw_handler_exit"
+
+typedef int (*vdw_handler_init_fn)(vdw_dev *dev, const vdw_map *map, void **ctx);
+typedef int (*vdw_handler_event_fn)(void *ctx, const vdw_map *map,
+		const vdw_uio_event *event);
+typedef void (*vdw_handler_exit_fn)(void *ctx);
+
+/* register access, offsets in bytes from the start of the map */
+static inline uint32_t vdw_read32(const vdw_map *map, size_t offset) {
+	return *(const volatile uint32_t*) ((const volatile uint8_t*) map->base + offset);
+}
+
+static inline void vdw_write32(const vdw_map *map, size_t offset, uint32_t value) {
+	*(volatile uint32_t*) ((volatile uint8_t*) map->base + offset) = value;
+}
+
+static inline uint64_t vdw_read64(const vdw_map *map, size_t offset) {
+	return *(const volatile uint64_t*) ((const volatile uint8_t*) map->base + offset);
+}
+
+static inline void vdw_write64(const vdw_map *map, size_t offset, uint64_t value) {
+	*(volatile uint64_t*) ((volatile uint8_t*) map->base + offset) = value;
+}
+
+/* bulk copies as 32-bit register accesses, for device windows that do
+ * not accept wider or byte accesses; count is in words
+ */
+static inline void vdw_read_block32(const vdw_map *map, size_t offset,
+		uint32_t *dst, size_t count) {
+	const volatile uint32_t *src = (const volatile uint32_t*)
+			((const volatile uint8_t*) map->base + offset);
+	while (count--) {
+		*dst++ = *src++;
+	}
+}
+
+static inline void vdw_write_block32(const vdw_map *map, size_t offset,
+		const uint32_t *src, size_t count) {
+	volatile uint32_t *dst = (volatile uint32_t*)
+			((volatile uint8_t*) map->base + offset);
+	while (count--) {
+		*dst++ = *src++;
+	}
+}
+
+/* bulk copies for memory backed maps (regaddress 0), plain memcpy */
+static inline void vdw_copy_from(const vdw_map *map, size_t offset,
+		void *dst, size_t len) {
+	memcpy(dst, (const uint8_t*) map->base + offset, len);
+}
+
+static inline void vdw_copy_to(const vdw_map *map, size_t offset,
+		const void *src, size_t len) {
+	memcpy((uint8_t*) map->base + offset, src, len);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBUIOVDW_H */
@@ -0,0 +1,180 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * uio_vdw.h
+ *
+ * Userspace IO for Vandewiele
+ *
+ * Layouts shared between the driver and userspace
+ */
+#ifndef UIO_VDW_H
+#define UIO_VDW_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* uio map index of the interrupt event ring, map 0 is the instance region */
+#define VDW_EVENTRING_MAP 1
+#define VDW_EVENTRING_VERSION 2
+#define VDW_EVENTRING_ENTRIES 512 // power of 2
+
+/* uio map index of the register snapshot page, instances with "snapshot="
+ * only, see vdw_uio_snapshot
+ */
+#define VDW_SNAPSHOT_MAP 2
+#define VDW_SNAPSHOT_VERSION 1
+
+/* synthetic instances (irq -2) with "seqwrite": map 0 offset of the __u64
+ * sequence number the generator stores before raising each event, gaps
+ * are events it dropped while the instance was masked
+ */
+#define VDW_GEN_SEQ_OFFSET 0
+
+/* registers an instance can snapshot per interrupt, see "capture=" */
+#define VDW_EVENT_REGS 8
+
+/* one interrupt, written by the driver for every interrupt it claims,
+ * one cache line
+ */
+typedef struct _vdw_uio_event {
+	__u64 seq; // 1 based, 0 while the driver rewrites the slot
+	__u64 timestamp; // ktime_get_ns(), CLOCK_MONOTONIC
+	__u32 cpu; // cpu that took the interrupt
+	__u32 nregs; // valid entries of regs, 0 for triggered events
+	__u32 regs[VDW_EVENT_REGS]; // "capture=" registers, read before the ack
+	__u32 line; // irq line of the instance, 0 for irq, 1.. for "irqs="
+	__u32 reserved;
+} vdw_uio_event;
+
+/* single producer ring, mapped read-only by any number of consumers
+ * (the driver refuses PROT_WRITE mappings of it, and of the snapshot)
+ * the producer fills a slot, then publishes it by writing its seq and
+ * then counter; event "seq" lives at ring[(seq - 1) % entries]
+ */
+typedef struct _vdw_uio_eventring {
+	__u32 version;
+	__u32 entries;
+	__u64 reserved[7];
+	__u64 counter; // seq of the last published event, own cache line
+	__u64 pad[7];
+	vdw_uio_event ring[];
+} vdw_uio_eventring;
+
+/* cacheable copy of a map 0 register range, refreshed by the driver every
+ * "snapus" microseconds or, with snapus 0, on every claimed interrupt
+ * seq is odd while the driver copies, a reader retries until it read the
+ * same even seq before and after its copy, see vdw_snapshot_read()
+ */
+typedef struct _vdw_uio_snapshot {
+	__u32 version;
+	__u32 size; // bytes in data
+	__u32 offset; // map 0 offset of data[0]
+	__u32 reserved0;
+	__u64 seq;
+	__u64 timestamp; // ktime_get_ns() when the copy completed
+	__u64 count; // copies taken
+	__u64 reserved[3];
+	__u32 data[];
+} vdw_uio_snapshot;
+
+/* control device, ioctls that hand back file descriptors */
+#define VDW_CTL_DEVICE "/dev/uio_vdw"
+#define VDW_IOC_MAGIC 'V'
+
+/* VDW_IOC_EXPORT_DMABUF: the memory of a kernel allocated instance
+ * (regaddress 0) as dma-buf, mmap of the fd uses the instance mapping
+ * mode, DMA_BUF_IOCTL_SYNC brackets cpu access
+ */
+typedef struct _vdw_dmabuf_export {
+	__u32 id; // instance id, /sys/class/uio/uioX/device/id
+	__u32 flags; // O_CLOEXEC, O_RDONLY/O_RDWR (default O_RDWR)
+	__s32 fd; // out
+	__u32 reserved;
+} vdw_dmabuf_export;
+
+#define VDW_IOC_EXPORT_DMABUF _IOWR(VDW_IOC_MAGIC, 1, vdw_dmabuf_export)
+
+/* VDW_IOC_EVENTFD: signal an eventfd for every event of an instance, or
+ * with a mask only for interrupts whose "cause=" register has one of the
+ * mask bits set, so each worker is woken for its own causes; lines
+ * narrows it down to some of the interrupt lines, an eventfd per line
+ * is an event counter of that line alone
+ * eventfds are signalled per event, moderation only applies to /dev/uioX
+ */
+typedef struct _vdw_eventfd_assign {
+	__u32 id; // instance id, /sys/class/uio/uioX/device/id
+	__s32 fd; // eventfd
+	__u32 mask; // cause bits, 0: every event, triggered events included
+	__u32 flags; // VDW_EVENTFD_DEASSIGN
+	__u32 lines; // bit per irq line (see vdw_uio_event), 0: every line
+	__u32 reserved;
+} vdw_eventfd_assign;
+
+#define VDW_EVENTFD_DEASSIGN 1 // remove fd again, mask and lines are ignored
+
+#define VDW_IOC_EVENTFD _IOW(VDW_IOC_MAGIC, 2, vdw_eventfd_assign)
+
+#ifndef __KERNEL__
+/*! copy event "seq" out of the ring
+ * @return 0 on success, -1 when the slot was overwritten already (the
+ * consumer fell more than entries events behind)
+ */
+static inline int vdw_eventring_read(const volatile vdw_uio_eventring *ring,
+		__u64 seq, vdw_uio_event *event) {
+	const volatile vdw_uio_event *slot = &ring->ring[(seq - 1)
+			& (ring->entries - 1)];
+	__u64 before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+	event->timestamp = slot->timestamp;
+	event->cpu = slot->cpu;
+	event->nregs = slot->nregs;
+	event->line = slot->line;
+	for (__u32 iter = 0; iter < VDW_EVENT_REGS; iter++) {
+		event->regs[iter] = slot->regs[iter];
+	}
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (before != seq || slot->seq != seq) {
+		return -1;
+	}
+	event->seq = seq;
+	return 0;
+}
+
+/*! consistent copy of the first size bytes of the snapshot data
+ * @return number of retries (the driver was copying), size is clamped
+ * to the snapshot size, *timestamp (if not NULL) of the copy read
+ */
+static inline unsigned vdw_snapshot_read(const volatile vdw_uio_snapshot *snap,
+		__u32 *dst, __u32 size, __u64 *timestamp) {
+	unsigned retries = 0;
+	__u64 seq, ts;
+
+	if (size > snap->size) {
+		size = snap->size;
+	}
+	for (;; ++retries) {
+		seq = __atomic_load_n(&snap->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			continue;
+		}
+		for (__u32 iter = 0; iter < size / 4; iter++) {
+			dst[iter] = snap->data[iter];
+		}
+		ts = snap->timestamp;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (snap->seq == seq) {
+			break;
+		}
+	}
+	if (timestamp) {
+		*timestamp = ts;
+	}
+	return retries;
+}
+
+/*! sequence number of the last published event, cheap enough to spin on */
+static inline __u64 vdw_eventring_counter(const volatile vdw_uio_eventring *ring) {
+	return __atomic_load_n(&ring->counter, __ATOMIC_ACQUIRE);
+}
+#endif
+
+#endif /* UIO_VDW_H */
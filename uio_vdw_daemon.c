@@ -0,0 +1,443 @@
+/*
+ * uio_vdw_daemon.c
+ *
+ * Long running interrupt consumer for one uio_vdw instance: pinned to a
+ * cpu, optionally SCHED_FIFO, all memory locked and prefaulted before the
+ * first event, every event handed to a handler loaded from a shared
+ * object (see libuiovdw.h), wakeup latency and jitter kept as it runs.
+ *
+ * Runs in the foreground, under systemd or a supervisor; SIGINT/SIGTERM
+ * (and SIGALRM, see -t) stop it, SIGUSR1 prints the statistics so far.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <poll.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <math.h>
+#include <sched.h>
+#include <signal.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+
+#include "libuiovdw.h"
+
+#define APP_NAME "uio_vdw_daemon"
+#define APP_VERSION "1.0.0"
+#define UIODEV "/dev/uio"
+#define DRV_DEVICE_NAME "uio_vdw_device"
+
+#define HIST_STEP_NS 10
+#define HIST_BUCKETS 100000 // 10 ns steps up to 1 ms, above goes to max only
+#define STACK_PREFAULT (256 * 1024)
+#define POLL_TIMEOUT_MS 1000
+
+typedef enum _strategy {
+	WAIT_BLOCK = 0, // blocking read()
+	WAIT_POLL, // poll() then read()
+	WAIT_SPIN, // spin on the event ring counter, no syscall
+	WAIT_COUNT,
+} strategy;
+
+static const char * const strategynames[] = {
+	[WAIT_BLOCK] = "block",
+	[WAIT_POLL] = "poll",
+	[WAIT_SPIN] = "spin",
+};
+
+/* wakeup latency (event timestamp to handler call) and the spread of the
+ * intervals between events
+ */
+typedef struct _stats {
+	uint64_t *buckets;
+	uint64_t count;
+	uint64_t overflow;
+	uint64_t max;
+	uint64_t sum;
+	uint64_t lost; // overwritten in the ring before we got to them
+	uint64_t handlererrors;
+	uint64_t lastts; // timestamp of the previous event
+	uint64_t intervals;
+	double intervalmean; // Welford, ns
+	double intervalm2;
+	uint64_t intervalmin;
+	uint64_t intervalmax;
+} stats;
+
+typedef struct _handler {
+	void *so;
+	void *ctx;
+	vdw_handler_init_fn init;
+	vdw_handler_event_fn event;
+	vdw_handler_exit_fn exit;
+} handler;
+
+static volatile sig_atomic_t stop;
+static volatile sig_atomic_t report;
+
+static void onsignal(int sig) {
+	if (sig == SIGUSR1) {
+		report = 1;
+	} else {
+		stop = 1;
+	}
+}
+
+static uint64_t nowns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void statsadd(stats *st, const vdw_uio_event *event, uint64_t now) {
+	uint64_t ns = now > event->timestamp ? now - event->timestamp : 0;
+	uint64_t bucket = ns / HIST_STEP_NS;
+
+	if (bucket < HIST_BUCKETS) {
+		++st->buckets[bucket];
+	} else {
+		++st->overflow;
+	}
+	if (ns > st->max) {
+		st->max = ns;
+	}
+	st->sum += ns;
+	++st->count;
+
+	if (st->lastts && event->timestamp > st->lastts) {
+		uint64_t interval = event->timestamp - st->lastts;
+		double delta = interval - st->intervalmean;
+		++st->intervals;
+		st->intervalmean += delta / st->intervals;
+		st->intervalm2 += delta * (interval - st->intervalmean);
+		if (!st->intervalmin || interval < st->intervalmin) {
+			st->intervalmin = interval;
+		}
+		if (interval > st->intervalmax) {
+			st->intervalmax = interval;
+		}
+	}
+	st->lastts = event->timestamp;
+}
+
+static double statspercentile(const stats *st, double fraction) {
+	uint64_t target = (uint64_t) (fraction * st->count);
+	uint64_t seen = 0;
+	for (uint64_t iter = 0; iter < HIST_BUCKETS; iter++) {
+		seen += st->buckets[iter];
+		if (seen > target) {
+			return (double) (iter * HIST_STEP_NS);
+		}
+	}
+	return (double) st->max;
+}
+
+static void statsprint(const stats *st) {
+	if (!st->count) {
+		fprintf(stderr, "no events\r\n");
+		return;
+	}
+	fprintf(stderr, "events %llu lost %llu handler errors %llu\r\n",
+			(unsigned long long) st->count, (unsigned long long) st->lost,
+			(unsigned long long) st->handlererrors);
+	fprintf(stderr, "latency avg %.2f us p50 %.2f us p99 %.2f us p99.9 %.2f us max %.2f us\r\n",
+			st->sum / 1000.0 / st->count, statspercentile(st, 0.5) / 1000.0,
+			statspercentile(st, 0.99) / 1000.0,
+			statspercentile(st, 0.999) / 1000.0, st->max / 1000.0);
+	if (st->intervals > 1) {
+		fprintf(stderr, "interval avg %.2f us stddev %.2f us min %.2f us max %.2f us\r\n",
+				st->intervalmean / 1000.0,
+				sqrt(st->intervalm2 / (st->intervals - 1)) / 1000.0,
+				st->intervalmin / 1000.0, st->intervalmax / 1000.0);
+	}
+}
+
+/* fault in the stack this thread will use, mlockall() keeps it */
+static void __attribute__((noinline)) prefaultstack(void) {
+	volatile char stack[STACK_PREFAULT];
+	for (size_t iter = 0; iter < sizeof(stack); iter += 4096) {
+		stack[iter] = 0;
+	}
+}
+
+static int setup(int cpu, int fifoprio, bool lock) {
+	if (cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set)) {
+			perror("sched_setaffinity");
+			return -1;
+		}
+	}
+	if (fifoprio > 0) {
+		struct sched_param param = { .sched_priority = fifoprio, };
+		if (sched_setscheduler(0, SCHED_FIFO, &param)) {
+			perror("SCHED_FIFO");
+			return -1;
+		}
+	}
+	if (lock) {
+		// current and future pages, the mappings are populated already
+		if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+			perror("mlockall");
+			return -1;
+		}
+		prefaultstack();
+	}
+	return 0;
+}
+
+static int loadhandler(handler *h, const char *path, vdw_dev *dev,
+		const vdw_map *map) {
+	if (!path) {
+		return 0;
+	}
+	// resolve everything now, no lazy binding on the event path
+	h->so = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (!h->so) {
+		fprintf(stderr, "%s\r\n", dlerror());
+		return -1;
+	}
+	h->event = (vdw_handler_event_fn) dlsym(h->so, VDW_HANDLER_EVENT);
+	h->init = (vdw_handler_init_fn) dlsym(h->so, VDW_HANDLER_INIT);
+	h->exit = (vdw_handler_exit_fn) dlsym(h->so, VDW_HANDLER_EXIT);
+	if (!h->event) {
+		fprintf(stderr, "%s: no %s\r\n", path, VDW_HANDLER_EVENT);
+		return -1;
+	}
+	if (h->init && h->init(dev, map, &h->ctx)) {
+		fprintf(stderr, "%s: %s failed\r\n", path, VDW_HANDLER_INIT);
+		h->exit = 0;
+		return -1;
+	}
+	return 0;
+}
+
+static void unloadhandler(handler *h) {
+	if (h->exit) {
+		h->exit(h->ctx);
+	}
+	if (h->so) {
+		dlclose(h->so);
+	}
+}
+
+/* wait until the ring has moved past lastseq, 1 when it did, 0 on
+ * timeout or signal, -1 on error
+ */
+static int waitevents(vdw_dev *dev, strategy strat,
+		const volatile vdw_uio_eventring *ring, uint64_t lastseq) {
+	uint32_t info;
+
+	switch (strat) {
+	case WAIT_BLOCK:
+		if (read(vdw_fd(dev), &info, sizeof(info)) == (ssize_t) sizeof(info)) {
+			return 1;
+		}
+		return errno == EINTR ? 0 : -1;
+	case WAIT_POLL: {
+		int ret = vdw_event_wait(dev, &info, POLL_TIMEOUT_MS);
+		return (ret < 0 && errno == EINTR) ? 0 : ret;
+	}
+	case WAIT_SPIN:
+		while (vdw_eventring_counter(ring) == lastseq) {
+			if (stop || report) {
+				return 0;
+			}
+		}
+		vdw_event_try(dev, &info); // keep the uio counter drained
+		return 1;
+	default:
+		return -1;
+	}
+}
+
+static int run(vdw_dev *dev, const vdw_map *map,
+		const volatile vdw_uio_eventring *ring, strategy strat, handler *h,
+		stats *st) {
+	bool irqcontrol = !vdw_irq_enable(dev, 1);
+	uint64_t lastseq = vdw_eventring_counter(ring);
+
+	while (!stop) {
+		uint64_t counter, now;
+		int ret = waitevents(dev, strat, ring, lastseq);
+
+		if (ret < 0) {
+			perror("wait");
+			return -1;
+		}
+		if (report) {
+			report = 0;
+			statsprint(st);
+		}
+		now = nowns();
+		counter = vdw_eventring_counter(ring);
+		if (counter - lastseq > ring->entries) {
+			st->lost += counter - lastseq - ring->entries;
+			lastseq = counter - ring->entries;
+		}
+		while (lastseq < counter) {
+			vdw_uio_event event;
+			if (vdw_eventring_read(ring, ++lastseq, &event)) {
+				++st->lost;
+				continue;
+			}
+			statsadd(st, &event, now);
+			if (h->event && h->event(h->ctx, map, &event)) {
+				++st->handlererrors;
+			}
+		}
+		if (irqcontrol && ret > 0) {
+			vdw_irq_enable(dev, 1);
+		}
+	}
+	return 0;
+}
+
+void printhelp() {
+	/* hd:c:f:H:w:t:M */
+	const char *helpstring =
+			APP_NAME " real-time event consumer\r\n"
+					"options:\r\n"
+					"\th: print this help\r\n"
+					"\td <x>: HEX select /dev/uio<x> instead of the first 'uio_vdw_device' device\r\n"
+					"\tc <x>: DEC pin to cpu x, -1: the cpus local to the instance (default)\r\n"
+					"\tf <x>: DEC run SCHED_FIFO at priority x (default: normal scheduling)\r\n"
+					"\tH <x>: handler shared object, see vdw_handler_event_fn in libuiovdw.h\r\n"
+					"\tw <x>: wait strategy block, poll (default) or spin\r\n"
+					"\tt <x>: DEC stop after x seconds (default: run until SIGINT/SIGTERM)\r\n"
+					"\tM: do not mlockall()\r\n";
+	fprintf(stderr, "%s", helpstring);
+}
+
+int main(int argc, char *argv[]) {
+	int error = -1;
+	int devsel = -1;
+	int cpu = -1;
+	int fifoprio = 0;
+	const char *handlerpath = 0;
+	strategy strat = WAIT_POLL;
+	uint32_t seconds = 0;
+	bool lock = true;
+	vdw_dev *dev = 0;
+	vdw_map map = { 0 };
+	vdw_map ringmap = { 0 };
+	const volatile vdw_uio_eventring *ring;
+	handler h = { 0 };
+	stats st = { 0 };
+	struct sigaction action = { .sa_handler = onsignal, }; // no SA_RESTART
+	int opt = 0;
+
+	fprintf(stderr, "%s - %s (build %s / %s)\r\n", APP_NAME, APP_VERSION,
+			__DATE__, __TIME__);
+
+	while ((opt = getopt(argc, argv, "hd:c:f:H:w:t:M")) != -1) {
+		switch (opt) {
+		case 'd':
+			devsel = (int) strtol(optarg, NULL, 16);
+			break;
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 'f':
+			fifoprio = atoi(optarg);
+			break;
+		case 'H':
+			handlerpath = optarg;
+			break;
+		case 'w':
+			for (strat = 0; strat < WAIT_COUNT; strat++) {
+				if (!strcmp(optarg, strategynames[strat])) {
+					break;
+				}
+			}
+			if (strat == WAIT_COUNT) {
+				fprintf(stderr, "unknown wait strategy %s\r\n", optarg);
+				goto exit_func;
+			}
+			break;
+		case 't':
+			seconds = strtoul(optarg, NULL, 10);
+			break;
+		case 'M':
+			lock = false;
+			break;
+		case 'h':
+		default:
+			printhelp();
+			goto exit_func;
+		}
+	}
+
+	if (devsel < 0) {
+		devsel = vdw_find_nth(DRV_DEVICE_NAME, 0);
+	}
+	if (devsel < 0) {
+		fprintf(stderr, "no %s device found\r\n", DRV_DEVICE_NAME);
+		goto exit_func;
+	}
+	dev = vdw_open(devsel);
+	if (!dev) {
+		perror("uio open:");
+		goto exit_func;
+	}
+	if (vdw_map_region(dev, 0, &map) || vdw_map_events(dev, &ringmap)) {
+		perror("uio mmap:");
+		goto exit_func;
+	}
+	ring = ringmap.base;
+	if (ring->version != VDW_EVENTRING_VERSION) {
+		fprintf(stderr, "event ring version %u, expected %u\r\n",
+				ring->version, VDW_EVENTRING_VERSION);
+		goto exit_func;
+	}
+	// the block strategy sleeps in read(), the library opens non-blocking
+	if (strat == WAIT_BLOCK) {
+		fcntl(vdw_fd(dev), F_SETFL, fcntl(vdw_fd(dev), F_GETFL) & ~O_NONBLOCK);
+	}
+
+	// touched now so mlockall() finds it resident
+	st.buckets = malloc(HIST_BUCKETS * sizeof(*st.buckets));
+	if (!st.buckets) {
+		perror("malloc");
+		goto exit_func;
+	}
+	memset(st.buckets, 0, HIST_BUCKETS * sizeof(*st.buckets));
+
+	if (cpu < 0 && vdw_pin_local(dev)) {
+		fprintf(stderr, "cannot pin to the instance cpus\r\n");
+	}
+	if (loadhandler(&h, handlerpath, dev, &map)
+			|| setup(cpu, fifoprio, lock)) {
+		goto exit_func;
+	}
+
+	sigaction(SIGINT, &action, 0);
+	sigaction(SIGTERM, &action, 0);
+	sigaction(SIGUSR1, &action, 0);
+	sigaction(SIGALRM, &action, 0);
+	alarm(seconds); // wakes a blocked read() or a spin without events
+	fprintf(stderr, "%s%d %s: cpu %d, %s, wait %s, handler %s\r\n", UIODEV,
+			devsel, vdw_name(devsel), sched_getcpu(),
+			fifoprio > 0 ? "SCHED_FIFO" : "SCHED_OTHER", strategynames[strat],
+			handlerpath ? handlerpath : "none");
+
+	error = run(dev, &map, ring, strat, &h, &st);
+	statsprint(&st);
+
+	exit_func: unloadhandler(&h);
+	free(st.buckets);
+	vdw_unmap(&ringmap);
+	vdw_unmap(&map);
+	vdw_close(dev);
+	return error;
+}
@@ -6,6 +6,8 @@
  *
  * Base Functions
  */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/platform_device.h>
@@ -18,50 +20,324 @@
 #include <linux/pm_runtime.h>
 #include <linux/slab.h>
 #include <linux/irq.h>
+#include <linux/dma-mapping.h>
+#include <linux/string.h>
+#include <linux/mm.h>
+#include <linux/huge_mm.h>
+#include <linux/version.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/xarray.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/configfs.h>
+#include <linux/irq_work.h>
+#include <linux/dma-buf.h>
+#include <linux/miscdevice.h>
+#include <linux/refcount.h>
+#include <linux/scatterlist.h>
+#include <linux/uaccess.h>
+#include <linux/cpumask.h>
+#include <linux/topology.h>
+#include <linux/smp.h>
+#include <linux/eventfd.h>
+#include <linux/sched/signal.h>
+#include <linux/compat.h>
 
 #include <linux/of.h>
 #include <linux/of_platform.h>
 #include <linux/of_address.h>
 
+#include "uio_vdw.h"
+
+#define CREATE_TRACE_POINTS
+#include "uio_vdw_trace.h"
+
 #define DRV_NAME "uio_vdw"
 #define DRV_DEVICE_NAME "uio_vdw_device"
+#ifndef USE_PROBE // "make probetest" builds with USE_PROBE=1
 #define USE_PROBE 0
+#endif
 
 #if defined(CONFIG_OF)
 static const struct of_device_id vdw_dt_ids[] = {
-    { .compatible = "vandewiele,"DRV_NAME }
+    { .compatible = "vandewiele,"DRV_NAME },
+    { } // sentinel
 };
 #endif
 
 // forward declaration
 typedef struct _vdw_uio_dev_priv *vdw_uio_dev_priv_ptr;
 
+/* mapping mode of the instance region, selected with the ":mode" suffix
+ * on the size field of devregions/devadd, applied by vdw_uio_mmap()
+ */
+typedef enum _vdw_uio_mapmode {
+	VDW_MAP_UNCACHED = 0, // default, pgprot_noncached(), control registers
+	VDW_MAP_CACHED, // kernel buffer: coherency through "sync" attribute
+	VDW_MAP_WC, // pgprot_writecombine(), streaming windows and FIFOs
+} vdw_uio_mapmode;
+
+/* allocator behind a regaddress 0 region, selected with a ":backend"
+ * suffix next to the mapping mode
+ */
+typedef enum _vdw_uio_backend {
+	VDW_ALLOC_KMALLOC = 0, // default, kzalloc(GFP_DMA), a few MB at most
+	VDW_ALLOC_CONTIG, // high-order pages or CMA, mapped with PMD pages
+} vdw_uio_backend;
+
+/* interrupt moderation, see vdw_moder_event()
+ * irq mode: notify once maxevents are pending or maxdelayus after the
+ * first pending event, whichever comes first
+ * poll mode: entered when the event rate exceeds highrate, the hardirq
+ * only counts and the hrtimer notifies every pollus until the rate
+ * falls below lowrate
+ */
+typedef struct _vdw_uio_moder {
+	raw_spinlock_t lock;
+	struct hrtimer timer;
+	u32 maxevents; // 0 or 1: notify every event
+	u32 maxdelayus; // 0: no deadline
+	u32 highrate; // events/s, 0: adaptive polling disabled
+	u32 lowrate; // events/s
+	u32 pollus;
+	bool pollmode;
+	u32 pending;
+	u64 windowstart;
+	u32 windowevents;
+	u64 events; // statistics
+	u64 notifies;
+	u64 pollswitches;
+} vdw_uio_moder;
+
+#define VDW_MODER_WINDOW_NS (10 * NSEC_PER_MSEC)
+#define VDW_MODER_POLL_US 100
+#define VDW_MODER_MIN_POLL_US 10 // poll_usecs below this is a timer storm
+#define VDW_MODER_MAX_EVENTS 65536
+
+/* irq number of an instance whose events come from vdw_gen_timer() */
+#define VDW_IRQ_SYNTHETIC (-2)
+
+/* synthetic interrupt source: every period the hrtimer raises "burst"
+ * events back to back through vdw_uio_irq(), period = burst / rate
+ * events found masked (automask, or irqcontrol 0) are dropped, their
+ * sequence numbers are skipped so consumers see the gap
+ */
+typedef struct _vdw_uio_gen {
+	struct hrtimer timer;
+	u32 rate; // events/s, 0: stopped
+	u32 burst; // events per expiry, 0 or 1: single events
+	bool seqwrite; // store seq at VDW_GEN_SEQ_OFFSET of map 0 first
+	u64 seq; // statistics
+	u64 dropped;
+	u64 overruns; // timer periods missed
+} vdw_uio_gen;
+
+#define VDW_GEN_MIN_PERIOD_NS 1000
+
+/* registers the top half reads and acks, byte offsets into map 0
+ * device memory goes through an ioremap() of the region, kernel memory
+ * is read directly and the ack clears bits like a write-1-to-clear
+ * register would, so synthetic instances can stand in for a device
+ */
+typedef struct _vdw_uio_regs {
+	u32 capture[VDW_EVENT_REGS]; // snapshot into the event, in this order
+	u32 ncapture;
+	u32 ackoffset;
+	u32 ackmask; // 0: no ack
+	u32 pendingoffset;
+	u32 pendingmask; // 0: every interrupt on the line is ours
+	u32 causeoffset;
+	u32 causemask; // 0: no cause register, eventfds cannot filter
+} vdw_uio_regs;
+
+/* eventfds of an instance, see VDW_IOC_EVENTFD, replaced as a whole on
+ * every change so the interrupt walks them under rcu without a lock
+ */
+typedef struct _vdw_uio_efds {
+	struct rcu_head rcu;
+	struct eventfd_ctx *drop; // left out of the list replacing this one
+	u32 count;
+	struct {
+		struct eventfd_ctx *ctx;
+		u32 mask; // cause bits, 0: every event
+		u32 lines; // bit per irq line, 0: every line
+	} entry[];
+} vdw_uio_efds;
+
+#define VDW_EVENTFDS_MAX 64
+
+/* periodic copy of a map 0 register range into mem[VDW_SNAPSHOT_MAP],
+ * written under a sequence counter so any number of readers can poll
+ * it without a syscall, see vdw_snapshot_read() in uio_vdw.h
+ */
+typedef struct _vdw_uio_snap {
+	struct hrtimer timer; // periodus != 0
+	raw_spinlock_t lock; // interrupt writers on several lines, see take
+	vdw_uio_snapshot *page;
+	size_t pagesize;
+	u32 offset;
+	u32 size; // bytes, 0: no snapshot page
+	u32 periodus; // 0: on every claimed interrupt
+} vdw_uio_snap;
+
+#define VDW_SNAP_MIN_PERIOD_US 10
+/* snapshots taken by the handler copy with interrupts off, keep it short */
+#define VDW_SNAP_IRQ_MAX 256
+
+/* interrupt lines per instance, irq plus "irqs=" */
+#define VDW_MAXIRQS 8
+
+/* further device memory windows of a block, "maps=", mapped as uio maps
+ * after the region and the driver's own maps, see vdw_uio_windowmap()
+ */
+#define VDW_MAXWINDOWS (MAX_UIO_MAPS - VDW_EVENTRING_MAP - 1)
+/* uio and map names, DRV_DEVICE_NAME_<64-bit hex>_snapshot fits */
+#define VDW_NAMELEN 48
+/* instances per devadd entry, see "count=" */
+#define VDW_MAXCOUNT 4096
+
+typedef struct _vdw_uio_window {
+	uintptr_t start; // page aligned
+	u32 size;
+} vdw_uio_window;
+
+/* uio map index of the first window, right after the snapshot page
+ * when there is one, otherwise after the event ring
+ */
+static inline u32 vdw_uio_windowmap(bool snapshot) {
+	return snapshot ? VDW_SNAPSHOT_MAP + 1 : VDW_EVENTRING_MAP + 1;
+}
+
+/* instance description as parsed from devregions/devadd */
+typedef struct _vdw_uio_params {
+	int irq;
+	uintptr_t regstart;
+	uint32_t regsize;
+	vdw_uio_mapmode mapmode;
+	vdw_uio_backend backend;
+	bool automask;
+	u32 genrate; // VDW_IRQ_SYNTHETIC instances only
+	u32 genburst;
+	bool genseqwrite;
+	int node; // NUMA_NO_NODE: node of cpu, or wherever the allocator likes
+	int cpu; // -1: no irq affinity
+	vdw_uio_regs regs;
+	u32 snapoffset;
+	u32 snapsize; // 0: no snapshot page
+	u32 snapus;
+	int irqs[VDW_MAXIRQS - 1]; // lines besides irq
+	u32 nirqs;
+	vdw_uio_window windows[VDW_MAXWINDOWS];
+	u32 nwindows;
+	u32 count; // devadd/devregions only, identical instances to create
+} vdw_uio_params;
+
 typedef struct _vdw_uio_dev_priv {
+	struct rcu_head rcu; // freed after registry lookups are done with it
+	u32 id; // stable registry index, also in the device name
 	struct uio_info info;
 	struct device dev;
 	void *memalloc;
+	struct page *mempages; // contig backend, first page of the region
+	bool memcma; // contig backend, region obtained through dma_alloc_pages
+	dma_addr_t memdma; // streaming mapping of memalloc in cached mode
 	int irq;
 	ulong regstart;
 	uint regsize;
-	vdw_uio_dev_priv_ptr pnext;
+	vdw_uio_mapmode mapmode;
+	vdw_uio_backend backend;
+	bool irqrequested; // irq owned by the driver, uio sees UIO_IRQ_CUSTOM
+	int irqs[VDW_MAXIRQS]; // requested lines, irqs[0] is irq
+	int nirqs;
+	int maskedlines; // lines disabled while irqmasked is set
+	atomic64_t irqcounts[VDW_MAXIRQS]; // claimed events per line, 0 + triggers
+	bool automask; // mask the lines in the handler, unmask on write()
+	unsigned long irqmasked; // bit 0: this instance holds a disable_irq() per line
+	atomic64_t irqcount; // hardirq entries, claimed or not, all lines
+	u64 irqunmasks;
+	vdw_uio_moder moder;
+	vdw_uio_eventring *ring; // mem[VDW_EVENTRING_MAP]
+	size_t ringsize;
+	u64 ringseq;
+	raw_spinlock_t ringlock;
+	struct irq_work trigger; // software event, see trigger_store()
+	raw_spinlock_t triggerlock;
+	bool triggerlive; // uio registered, event sources and affinity may change
+	u64 triggers;
+	vdw_uio_gen gen;
+	int node; // memory and ring placement, also dev_to_node()
+	int cpu; // irq affinity, trigger and generator cpu, -1: any
+	refcount_t memrefs; // instance plus exported dma-bufs, see memput
+	u64 dmabufs; // dma-bufs exported so far
+	vdw_uio_regs regs;
+	void __iomem *regbase; // device memory instances with capture/ack
+	int ackindex; // capture[] entry of the ack register, -1: none
+	int pendingindex; // capture[] entry of the pending register, -1: none
+	int causeindex; // capture[] entry of the cause register, -1: none
+	atomic64_t acks; // handlers of several lines at once
+	atomic64_t irqnotours; // declined by the pending check, wakeups avoided
+	vdw_uio_snap snap;
+	vdw_uio_efds __rcu *efds; // ctllock for writers
+	atomic64_t eventfdsignals; // handlers of several lines at once
+	vdw_uio_window windows[VDW_MAXWINDOWS];
+	u32 nwindows;
+	char name[VDW_NAMELEN]; // info.name, no allocation per instance
+	char mapnames[MAX_UIO_MAPS][VDW_NAMELEN];
+	struct list_head batch; // batched removal, module.lock
+	u32 *ownerid; // id of the creator (configfs item), zeroed on removal
+	struct mutex ctllock; // /dev/uio_vdw ioctls, found through the registry
+	bool ctllive; // ctllock, cleared before the instance is torn down
 } vdw_uio_dev_priv, *vdw_uio_dev_priv_ptr;
 
+/* instance registry, ids are allocated once and never renumbered
+ * lock serializes adding and removing instances, lookups only take
+ * rcu_read_lock() and never wait for it
+ * ids are handed out cyclically, a removed id is not reused until the
+ * 31-bit space wraps, so a stale id finds nothing instead of a newcomer
+ */
 typedef struct _vdw_uio_module {
+	struct mutex lock;
+	struct xarray instances;
+	u32 nextid; // xa_alloc_cyclic() cursor, lock
 	int instancecount;
-	vdw_uio_dev_priv *uioinst;
 } vdw_uio_module;
 
-static vdw_uio_module module = { 0, 0 };
+#if !(defined(USE_PROBE) && (USE_PROBE!=0))
+/* instance registry and module parameters, probe builds have neither */
+static vdw_uio_module module = {
+	.lock = __MUTEX_INITIALIZER(module.lock),
+	.instances = XARRAY_INIT(module.instances, XA_FLAGS_ALLOC1),
+	.instancecount = 0,
+};
+
+static const char * const mapmodenames[] = {
+	[VDW_MAP_UNCACHED] = "uncached",
+	[VDW_MAP_CACHED] = "cached",
+	[VDW_MAP_WC] = "wc",
+};
+
+static const char * const backendnames[] = {
+	[VDW_ALLOC_KMALLOC] = "kmalloc",
+	[VDW_ALLOC_CONTIG] = "contig",
+};
 
 static char *devregions = "-1,0,4096"; // default
-static char devregionsstorage[4096];
 static char *devadd = ""; // default
 static int devrm = -1; // default
 
 // forward declarations
 static int simpledriver_instance_remove(int instance);
+static int simpledriver_instance_remove_batch(const char *ids);
 static int simpledriver_instance_add(const char* params);
-static int builddevregionsstring(void);
+static int builddevregionsstring(char *buffer, size_t size);
+static size_t vdw_capture_print(char *buffer, size_t size,
+		const vdw_uio_regs *regs);
+static size_t vdw_irqs_print(char *buffer, size_t size, const int *irqs,
+		u32 nirqs);
+static size_t vdw_windows_print(char *buffer, size_t size,
+		const vdw_uio_window *windows, u32 nwindows);
 
 /* module parameters are visible in /sys/module/uio_vdw/parameters
  * and can be manipulated either at
@@ -71,37 +347,155 @@ static int builddevregionsstring(void);
 
 /*! "devregions" can be manipulated at module load
  * @param devregions
- * interruptnr,regaddress,regsize[,interruptnr,regaddress,regsize]
+ * interruptnr,regaddress,regsize[:option...][,interruptnr,regaddress,regsize[:option...]]
+ * option is a mapping mode, "uncached" (default), "wc" or "cached", or for
+ * regaddress 0 an allocation backend, "kmalloc" (default) or "contig",
+ * or "automask" to mask the interrupt until userspace writes 1 to /dev/uioX
+ * interruptnr -2 is a synthetic hrtimer source, options "rate=<events/s>",
+ * "burst=<events per expiry>" and "seqwrite" (regaddress 0 only)
+ * placement: "node=<n>" allocates region and event ring on NUMA node n,
+ * "cpu=<n>" points the interrupt (and trigger, generator) at cpu n and
+ * implies its node; a placed region is not kept below 4 GB, the low
+ * dma zones only exist on the first node(s)
+ * top half: "capture=<off>[+<off>...]" reads up to 8 registers (hex byte
+ * offsets) into the event ring, "ack=<off>/<mask>" then acks the device
+ * by writing the captured bits of mask (just mask when the register is
+ * not captured) to the write-1-to-clear register at off
+ * "pending=<off>/<mask>" declines (IRQ_NONE) interrupts that find none of
+ * the mask bits set in the register at off, for shared lines
+ * "cause=<off>/<mask>" is read before the ack, eventfds registered with
+ * VDW_IOC_EVENTFD are only signalled for the mask bits they asked for
+ * "snapshot=<off>/<len>" (hex bytes) keeps a copy of the registers in uio
+ * map 2 for lock-free readers, refreshed every "snapus=<us>" or, without
+ * snapus, on every claimed interrupt (then at most 256 bytes)
+ * blocks: "irqs=<n>[+<n>...]" requests further interrupt lines (up to 8
+ * with interruptnr) for the same instance, each counted on its own and
+ * told apart in the event ring, "maps=<addr>/<size>[+...]" (hex) maps
+ * further device memory windows after the driver's own uio maps, in the
+ * region's mode but never "cached"
+ * bulk: "count=<n>" creates n identical instances from one entry
+ * (regaddress 0 only), parsed once and logged once
+ * a list that fails part way creates nothing, instances made by earlier
+ * entries of the same write are removed again
  */
-module_param( devregions, charp, S_IRUGO);
+static int param_get_devregions(char *buffer, const struct kernel_param *kp)
+{
+	int result;
+	mutex_lock(&module.lock);
+	result = builddevregionsstring(buffer, PAGE_SIZE);
+	mutex_unlock(&module.lock);
+	return result;
+}
+
+static struct kernel_param_ops param_ops_devregions = {
+ .set = param_set_charp,
+ .get = param_get_devregions,
+ .free = param_free_charp,
+};
+module_param_cb(devregions, &param_ops_devregions, &devregions, S_IRUGO);
 
-static int builddevregionsstring()
+/* devregions as read from sysfs: the live instances, built on demand in
+ * one pass, a trailing ",..." marks a list that does not fit
+ * called with module.lock held
+ */
+static int builddevregionsstring(char *buffer, size_t size)
 {
-	vdw_uio_dev_priv_ptr uioinst = module.uioinst;
-	memset(devregionsstorage, 0, sizeof(devregionsstorage));
-	while (uioinst) {
-		sprintf(&devregionsstorage[strlen(devregionsstorage)], "%d,%lx,%u",
-				uioinst->irq, uioinst->regstart, uioinst->regsize);
-		uioinst = uioinst->pnext;
-		if (uioinst) {
-			strcat(devregionsstorage, ",");
+	vdw_uio_dev_priv_ptr uioinst;
+	unsigned long id;
+	size_t len = 0;
+	size_t entrystart;
+	const size_t reserve = sizeof(",...\n");
+
+	buffer[0] = 0;
+	xa_for_each(&module.instances, id, uioinst) {
+		entrystart = len;
+		len += scnprintf(buffer + len, size - reserve - len, "%s%d,%lx,%u",
+				entrystart ? "," : "", uioinst->irq, uioinst->regstart,
+				uioinst->regsize);
+		if (uioinst->mapmode != VDW_MAP_UNCACHED) {
+			len += scnprintf(buffer + len, size - reserve - len, ":%s",
+					mapmodenames[uioinst->mapmode]);
+		}
+		if (uioinst->backend != VDW_ALLOC_KMALLOC) {
+			len += scnprintf(buffer + len, size - reserve - len, ":%s",
+					backendnames[uioinst->backend]);
+		}
+		if (uioinst->automask) {
+			len += scnprintf(buffer + len, size - reserve - len, ":automask");
+		}
+		if (uioinst->node != NUMA_NO_NODE) {
+			len += scnprintf(buffer + len, size - reserve - len, ":node=%d",
+					uioinst->node);
+		}
+		if (uioinst->cpu >= 0) {
+			len += scnprintf(buffer + len, size - reserve - len, ":cpu=%d",
+					uioinst->cpu);
+		}
+		if (uioinst->regs.ncapture) {
+			len += scnprintf(buffer + len, size - reserve - len, ":capture=");
+			len += vdw_capture_print(buffer + len, size - reserve - len,
+					&uioinst->regs);
+		}
+		if (uioinst->regs.ackmask) {
+			len += scnprintf(buffer + len, size - reserve - len, ":ack=%x/%x",
+					uioinst->regs.ackoffset, uioinst->regs.ackmask);
+		}
+		if (uioinst->regs.pendingmask) {
+			len += scnprintf(buffer + len, size - reserve - len,
+					":pending=%x/%x", uioinst->regs.pendingoffset,
+					uioinst->regs.pendingmask);
+		}
+		if (uioinst->regs.causemask) {
+			len += scnprintf(buffer + len, size - reserve - len,
+					":cause=%x/%x", uioinst->regs.causeoffset,
+					uioinst->regs.causemask);
+		}
+		if (uioinst->nirqs > 1) {
+			len += scnprintf(buffer + len, size - reserve - len, ":irqs=");
+			len += vdw_irqs_print(buffer + len, size - reserve - len,
+					uioinst->irqs + 1, uioinst->nirqs - 1);
+		}
+		if (uioinst->nwindows) {
+			len += scnprintf(buffer + len, size - reserve - len, ":maps=");
+			len += vdw_windows_print(buffer + len, size - reserve - len,
+					uioinst->windows, uioinst->nwindows);
+		}
+		if (uioinst->snap.size) {
+			len += scnprintf(buffer + len, size - reserve - len,
+					":snapshot=%x/%x", uioinst->snap.offset, uioinst->snap.size);
+		}
+		if (uioinst->snap.periodus) {
+			len += scnprintf(buffer + len, size - reserve - len, ":snapus=%u",
+					uioinst->snap.periodus);
+		}
+		if (uioinst->irq == VDW_IRQ_SYNTHETIC) {
+			len += scnprintf(buffer + len, size - reserve - len,
+					":rate=%u:burst=%u%s", uioinst->gen.rate,
+					uioinst->gen.burst,
+					uioinst->gen.seqwrite ? ":seqwrite" : "");
+		}
+		if (len >= size - reserve - 1) { // entry cut short, drop it
+			len = entrystart + scnprintf(buffer + entrystart,
+					size - entrystart, ",...");
+			break;
 		}
 	}
-	devregions = devregionsstorage;
-	return 0;
+	len += scnprintf(buffer + len, size - len, "\n");
+	return len;
 }
 
 /*! "devadd" can be manipulated at runtime
  * @param devadd
- * interruptnr,regaddress,regsize[,interruptnr,regaddress,regsize]
+ * interruptnr,regaddress,regsize[:option...][,interruptnr,regaddress,regsize[:option...]]
  */
 static int param_set_devadd(const char *val, const struct kernel_param *kp)
 {
 	int ret = 0;
-	printk(KERN_INFO "param_set_devadd = %s\n", val?val:"NULL");
+	pr_debug("param_set_devadd = %s\n", val?val:"NULL");
 	sscanf(val, "%d", &devrm);
+	mutex_lock(&module.lock);
 	ret = simpledriver_instance_add(val);
-	builddevregionsstring();
+	mutex_unlock(&module.lock);
 	return ret;
 }
 
@@ -109,7 +503,7 @@ static int param_get_devadd(char *buffer, const struct kernel_param *kp)
 {
 	int result = 0;
 	sprintf(buffer, "%d", module.instancecount);
-	printk(KERN_INFO "param_get_devadd = %s\n", buffer?buffer:"NULL");
+	pr_debug("param_get_devadd = %s\n", buffer?buffer:"NULL");
 	result = strlen(buffer);
 	return result;
 }
@@ -119,19 +513,19 @@ static struct kernel_param_ops param_ops_devadd = {
  .get = param_get_devadd,
 };
 
-/*! "devrm" can be manipulated at runtime
- * @param devrm
- * index to remove
+/*! "devadd" can be manipulated at runtime
+ * reading it returns the number of instances
  */
 module_param_cb(devadd, &param_ops_devadd, &devadd, (S_IRUSR|S_IWUSR));
 
 static int param_set_devrm(const char *val, const struct kernel_param *kp)
 {
 	int ret = 0;
-	printk(KERN_INFO "param_set_devrm = %s\n", val?val:"NULL");
+	pr_debug("param_set_devrm = %s\n", val?val:"NULL");
 	sscanf(val, "%d", &devrm);
-	ret = simpledriver_instance_remove(devrm);
-	builddevregionsstring();
+	mutex_lock(&module.lock);
+	ret = simpledriver_instance_remove_batch(val);
+	mutex_unlock(&module.lock);
 	return ret;
 }
 
@@ -139,7 +533,7 @@ static int param_get_devrm(char *buffer, const struct kernel_param *kp)
 {
 	int result = 0;
 	sprintf(buffer, "%d", module.instancecount);
-	printk(KERN_INFO "param_get_devrm = %s\n", buffer?buffer:"NULL");
+	pr_debug("param_get_devrm = %s\n", buffer?buffer:"NULL");
 	result = strlen(buffer);
 	return result;
 }
@@ -150,9 +544,12 @@ static struct kernel_param_ops param_ops_devrm = {
 };
 /*! "devrm" can be manipulated at runtime
  * @param devrm
- * index to remove
+ * id of the instance to remove, the N of uio_vdw_device_N, or a list
+ * id[-id][,id[-id]...] removed as one batch, ids of the remaining
+ * instances do not change
  */
 module_param_cb(devrm, &param_ops_devrm, &devrm, (S_IRUSR|S_IWUSR));
+#endif /* !USE_PROBE */
 
 /* if one wants to do work in kernel space (interrupt), this is the place
  * to put the code...
@@ -181,337 +578,3300 @@ static const struct dev_pm_ops uio_vdw_dev_pm_ops = { .runtime_suspend =
 		uio_vdw_runtime_nop, .runtime_resume = uio_vdw_runtime_nop, };
 
 #if defined(USE_PROBE) && (USE_PROBE!=0)
-/* Forward declaration of a probe routine */
-static int simpledriver_probe(struct platform_device *pdev);
+#define VDW_PROBE_MAXIRQS 8
 
-static struct platform_driver vdw_driver = {
-    .probe = simpledriver_probe,
-    .driver = {
-        .name = DRV_NAME,
-        .pm = &uio_vdw_dev_pm_ops,
-        .of_match_table = of_match_ptr(vdw_dt_ids),
-        .owner = THIS_MODULE,
-    }
-};
+/* one devicetree node (or a platform device called DRV_NAME), every
+ * memory resource becomes a uio map, every interrupt is requested by the
+ * driver and raises the one uio event, all of it devm managed
+ */
+typedef struct _vdw_probe_priv {
+	struct uio_info info;
+	struct device *dev;
+	void __iomem *regs[MAX_UIO_MAPS]; // kernel view, for vdw_uio_handler
+	int irqs[VDW_PROBE_MAXIRQS];
+	int nirqs;
+	unsigned long irqmasked; // bit 0: irqcontrol disabled all lines
+	u64 irqcounts[VDW_PROBE_MAXIRQS];
+} vdw_probe_priv;
+
+static irqreturn_t vdw_probe_irq(int irq, void *dev_id) {
+	vdw_probe_priv *priv = dev_id;
+	irqreturn_t ret = vdw_uio_handler(irq, &priv->info);
+	int index;
+
+	if (ret == IRQ_HANDLED) {
+		for (index = 0; index < priv->nirqs; index++) {
+			if (priv->irqs[index] == irq) {
+				++priv->irqcounts[index];
+				break;
+			}
+		}
+		uio_event_notify(&priv->info);
+	}
+	return ret;
+}
 
-module_platform_driver(vdw_driver);
+/* write() on /dev/uioX: 1 unmasks, 0 masks all lines of the node */
+static int vdw_probe_irqcontrol(struct uio_info *info, s32 irq_on) {
+	vdw_probe_priv *priv = info->priv;
+	int index;
 
-#if 0
-/* devicetree example */
-user_io@80000000 {
-    compatible = "vandewiele,uio_vdw";
-    regs = <0x20 0x80000000 0x0 0x1000>;
-    clock = <&xclk 0>;
-    interrupt-parent = <&L4>;
-    interrupts = <32>;
-    status = "okay";
-};
-#endif
+	if (irq_on) {
+		if (test_and_clear_bit(0, &priv->irqmasked)) {
+			for (index = 0; index < priv->nirqs; index++) {
+				enable_irq(priv->irqs[index]);
+			}
+		}
+	} else if (!test_and_set_bit(0, &priv->irqmasked)) {
+		for (index = 0; index < priv->nirqs; index++) {
+			disable_irq(priv->irqs[index]);
+		}
+	}
+	return 0;
+}
 
-/* Implement a probe routine */
-static int simpledriver_probe(struct platform_device *pdev)
-{
-    int ret;
-    struct resource * reg_base;
-    uint32_t len;
-    struct uio_mem *uiomem;
-    struct uio_info *linfo;
-    void __iomem * reg_vaddr;
-    int irq;
-    printk( KERN_NOTICE ""DRV_NAME" probe\n");
-
-    ret = -1;
-    reg_base = platform_get_resource(pdev, IORESOURCE_MEM, 0);
-    len = resource_size(reg_base);
-    printk( KERN_NOTICE "vdw-driver resource=%p, len=%u\n", reg_base, len);
-
-    linfo = dev_get_platdata(&pdev->dev);
-    printk( KERN_NOTICE "vdw-driver Running Probe, uioinfo=%p\n", linfo);
-
-    // kzalloc memory for the driver itself 
-
-    // Generate a virtual address for the hardware's base addr
-    reg_vaddr = ioremap(reg_base->start, len);
-
-    // Generate an IRQ entry for the hardware's IRQ
-    irq = platform_get_irq(pdev, 0);
-    
-    uiomem = &linfo->mem[0];
-
-    // Connect this info to the UIO subsystem
-    uiomem->addr = reg_base->start & PAGE_MASK;
-    uiomem->offs = reg_base->start & ~PAGE_MASK;
-    uiomem->size = len + uiomem->offs;
-    uiomem->memtype = UIO_MEM_PHYS;
-
-    linfo->mem[1].size = 0; // sentinel
-
-    ++module.instancecount;
-    linfo->name = kasprintf(GFP_KERNEL, "%s_%lx", DRV_DEVICE_NAME,
-        		(uintptr_t) (reg_base->start?reg_base->start:module.instancecount));
-    linfo->version = "1.0";
-    linfo->irq = irq;
-    linfo->irq_flags = IRQF_SHARED;
-    linfo->handler = vdw_uio_handler;  // We're going to provide our own handler
-
-    // Disable interrupts, e.g.?
-
-    // Register this driver with UIO subsystem,
-    ret = uio_register_device(&pdev->dev, linfo);
-    
-    if (0 == ret) {
-        printk( KERN_NOTICE "vdw-driver created vdw UIO device\n");
-    }
-    else {
-        printk( KERN_WARNING "vdw-driver failed to create vdw UIO device!\n");
-    }
-    
-    return ret;
+/* see uio_vdw_runtime_nop() */
+static int vdw_probe_open(struct uio_info *info, struct inode *inode) {
+	vdw_probe_priv *priv = info->priv;
+	pm_runtime_get_sync(priv->dev);
+	return 0;
 }
 
-#else
+static int vdw_probe_release(struct uio_info *info, struct inode *inode) {
+	vdw_probe_priv *priv = info->priv;
+	pm_runtime_put_sync(priv->dev);
+	return 0;
+}
 
-static void simpledriver_release(struct device *dev) {
-	printk(KERN_INFO "releasing vdw uio device\n");
+static void vdw_probe_unregister(void *data) {
+	uio_unregister_device(data);
 }
 
-static int simpledriver_instance_remove(int instance) {
-	int ret = -ENODEV;
-	int instanceiter = 0;
-	vdw_uio_dev_priv_ptr uioinst = module.uioinst;
-	vdw_uio_dev_priv_ptr uioinstnext = 0;
-	vdw_uio_dev_priv_ptr uioinstprev = 0;
-	printk( KERN_NOTICE "simpledriver_instance_remove begin, %d instances, remove %d\n",
-			module.instancecount, instance);
-	if (instance >= module.instancecount) {
-		printk( KERN_ERR "simpledriver_instance_remove, index %d out of bound!\n", instance);
-		goto exit_func;
-	}
-	while (uioinst && instanceiter < instance) {
-		uioinstnext = uioinst->pnext;
-		uioinstprev = uioinst;
-		uioinst = uioinstnext;
-		++instanceiter;
-	}
-	if (uioinst) {
-		printk(KERN_INFO "UnRegister UIO handler for IRQ=%d name=%s\n",
-				(int) uioinst->info.irq,
-				uioinst->info.name);
-		uioinstnext = uioinst->pnext;
-		uio_unregister_device(&uioinst->info);
-		device_unregister(&uioinst->dev);
-		kfree(uioinst->memalloc);
-		kfree(uioinst);
-		--module.instancecount;
-		if (uioinstprev) {
-			uioinstprev->pnext = uioinstnext;
-		}
-		else {
-			module.uioinst = uioinstnext;
-		}
-		ret = 0;
+static void vdw_probe_pm_disable(void *data) {
+	pm_runtime_disable(data);
+}
+
+/*! irqstats: "<irq> <count>" per interrupt of the node */
+static ssize_t irqstats_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_probe_priv *priv = dev_get_drvdata(dev);
+	size_t len = 0;
+	int index;
+
+	for (index = 0; priv && index < priv->nirqs; index++) {
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%d %llu\n",
+				priv->irqs[index], priv->irqcounts[index]);
 	}
-	exit_func:
-	printk( KERN_NOTICE "simpledriver_instance_remove, %d instances left\n", module.instancecount);
-	return ret;
+	return len;
 }
+static DEVICE_ATTR_RO(irqstats);
 
-static int simpledriver_instance_init(int irq, uintptr_t regstart,
-	uint32_t regsize) {
-	int error = -1;
-	bool devregistered = false;
-	struct uio_mem *uiomem = 0;
-	vdw_uio_dev_priv_ptr uioinst = 0;
+static struct attribute *vdw_probe_attrs[] = {
+	&dev_attr_irqstats.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(vdw_probe);
 
-	printk(KERN_INFO "instance_init irq=%d start=%lx size=%u\n",
-			irq, regstart, regsize);
+static int simpledriver_probe(struct platform_device *pdev)
+{
+	struct device *dev = &pdev->dev;
+	vdw_probe_priv *priv;
+	struct resource *res;
+	int index, nmaps, irq, ret;
+
+	priv = devm_kzalloc(dev, sizeof(*priv), GFP_KERNEL);
+	if (!priv) {
+		return -ENOMEM;
+	}
+	priv->dev = dev;
 
-	if (regstart % PAGE_SIZE) {
-		printk(KERN_WARNING "Reg space start must be page-aligned\n");
-		error = -EFAULT;
-		goto exit_func;
+	for (index = 0; index < MAX_UIO_MAPS; index++) {
+		struct uio_mem *uiomem = &priv->info.mem[index];
+		res = platform_get_resource(pdev, IORESOURCE_MEM, index);
+		if (!res) {
+			break;
+		}
+		priv->regs[index] = devm_ioremap_resource(dev, res);
+		if (IS_ERR(priv->regs[index])) {
+			dev_err(dev, "cannot map resource %d %pR\n", index, res);
+			return PTR_ERR(priv->regs[index]);
+		}
+		uiomem->name = res->name;
+		uiomem->addr = res->start & PAGE_MASK;
+		uiomem->offs = res->start & ~PAGE_MASK;
+		uiomem->size = PAGE_ALIGN(uiomem->offs + resource_size(res));
+		uiomem->memtype = UIO_MEM_PHYS;
+	} // mem[index].size stays 0, the sentinel
+	nmaps = index;
+	if (!nmaps) {
+		dev_err(dev, "no memory resource\n");
+		return -EINVAL;
+	}
+	if (platform_get_resource(pdev, IORESOURCE_MEM, MAX_UIO_MAPS)) {
+		dev_warn(dev, "only the first %d memory resources are mapped\n",
+				MAX_UIO_MAPS);
 	}
 
-	uioinst = kzalloc(sizeof(vdw_uio_dev_priv), GFP_KERNEL);
-	if (!uioinst) {
-		printk(KERN_WARNING "Failing to allocate module struct\n");
-		error = -ENOMEM;
-		goto exit_func;
+	priv->nirqs = platform_irq_count(pdev);
+	if (priv->nirqs < 0) {
+		return priv->nirqs; // -EPROBE_DEFER while the controller is missing
+	}
+	if (priv->nirqs > VDW_PROBE_MAXIRQS) {
+		dev_warn(dev, "only the first %d interrupts are used\n",
+				VDW_PROBE_MAXIRQS);
+		priv->nirqs = VDW_PROBE_MAXIRQS;
 	}
 
-	printk(KERN_INFO "uioinst %px allocated\n", uioinst);
+	priv->info.name = devm_kasprintf(dev, GFP_KERNEL, "%s_%llx",
+			DRV_DEVICE_NAME, (unsigned long long)
+			(priv->info.mem[0].addr + priv->info.mem[0].offs));
+	if (!priv->info.name) {
+		return -ENOMEM;
+	}
+	priv->info.version = "1.0.0";
+	priv->info.priv = priv;
+	priv->info.irq = priv->nirqs ? UIO_IRQ_CUSTOM : UIO_IRQ_NONE;
+	if (priv->nirqs) {
+		priv->info.irqcontrol = vdw_probe_irqcontrol;
+	}
+	priv->info.open = vdw_probe_open;
+	priv->info.release = vdw_probe_release;
+	platform_set_drvdata(pdev, priv);
+
+	pm_runtime_enable(dev);
+	ret = devm_add_action_or_reset(dev, vdw_probe_pm_disable, dev);
+	if (ret) {
+		return ret;
+	}
 
-	if (!module.uioinst) {
-		module.uioinst = uioinst; // first instance
-		module.instancecount = 1;
-	} else {
-		vdw_uio_dev_priv_ptr uioinstnext = module.uioinst;
-		while (uioinstnext->pnext) {
-			uioinstnext = uioinstnext->pnext;
+	ret = uio_register_device(dev, &priv->info);
+	if (ret) {
+		dev_err(dev, "cannot register uio device (%d)\n", ret);
+		return ret;
+	}
+	ret = devm_add_action_or_reset(dev, vdw_probe_unregister, &priv->info);
+	if (ret) {
+		return ret;
+	}
+
+	/* after uio registration, devm frees the irqs before uio is
+	 * unregistered so the handler never notifies a dead uio device
+	 */
+	for (index = 0; index < priv->nirqs; index++) {
+		irq = platform_get_irq(pdev, index);
+		if (irq < 0) {
+			return irq;
+		}
+		priv->irqs[index] = irq;
+		ret = devm_request_irq(dev, irq, vdw_probe_irq, IRQF_SHARED,
+				priv->info.name, priv);
+		if (ret) {
+			dev_err(dev, "cannot request irq %d (%d)\n", irq, ret);
+			return ret;
 		}
-		uioinstnext->pnext = uioinst;
-		++module.instancecount;
 	}
 
-	printk(KERN_INFO "instance count = %d\n", module.instancecount);
+	dev_dbg(dev, "%s: %d maps, %d irqs\n", priv->info.name, nmaps, priv->nirqs);
+	return 0;
+}
 
-	dev_set_name(&uioinst->dev, "%s_%d", DRV_DEVICE_NAME, module.instancecount);
-	uioinst->dev.release = simpledriver_release;
+/* drop a disable_irq() depth level held through irqcontrol, sharers of
+ * the lines keep working, devm releases the rest
+ */
+static void simpledriver_unmask(struct platform_device *pdev) {
+	vdw_probe_priv *priv = platform_get_drvdata(pdev);
+	int index;
 
-	if (device_register(&uioinst->dev)) {
-		printk(KERN_WARNING "Failing to register dev device\n");
-		error = -ENODEV;
-		goto exit_func;
+	if (test_and_clear_bit(0, &priv->irqmasked)) {
+		for (index = 0; index < priv->nirqs; index++) {
+			enable_irq(priv->irqs[index]);
+		}
 	}
+}
 
-	devregistered = true;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
+static void simpledriver_remove(struct platform_device *pdev) {
+	simpledriver_unmask(pdev);
+}
+#else
+static int simpledriver_remove(struct platform_device *pdev) {
+	simpledriver_unmask(pdev);
+	return 0;
+}
+#endif
 
-	uioinst->info.name = kasprintf(GFP_KERNEL, "%s_%lx", DRV_DEVICE_NAME,
-			(uintptr_t) (regstart ? regstart : module.instancecount));
-	printk(KERN_INFO "uioinst->info.name = %s\n", uioinst->info.name);
-	uioinst->info.version = "1.0.0";
-	uioinst->info.irq = irq;
-	uioinst->info.irq_flags = IRQF_SHARED;
-	uioinst->info.handler = vdw_uio_handler;
+/* asynchronous probe: boards with many vdw nodes do not serialize boot
+ * on this driver
+ */
+static struct platform_driver vdw_driver = {
+	.probe = simpledriver_probe,
+	.remove = simpledriver_remove,
+	.driver = {
+		.name = DRV_NAME,
+		.pm = &uio_vdw_dev_pm_ops,
+		.of_match_table = of_match_ptr(vdw_dt_ids),
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+		.dev_groups = vdw_probe_groups,
+	}
+};
 
-	// round to page
-	regsize = ((regsize + PAGE_SIZE - 1) / PAGE_SIZE) * PAGE_SIZE;
+module_platform_driver(vdw_driver);
+#if defined(CONFIG_OF)
+MODULE_DEVICE_TABLE(of, vdw_dt_ids);
+#endif
 
-	uiomem = &uioinst->info.mem[0];
-	// Connect this info to the UIO subsystem
-	uiomem->size = regsize;
-	uiomem->offs = 0;
-	uiomem->name = kasprintf(GFP_KERNEL, "%s%s", uioinst->info.name, "_map0");
-	printk(KERN_INFO "uiomem->name = %s\n", uiomem->name);
+#if 0
+/* devicetree example, any number of reg and interrupt entries */
+user_io@80000000 {
+    compatible = "vandewiele,uio_vdw";
+    reg = <0x0 0x80000000 0x0 0x1000>, <0x0 0x80010000 0x0 0x100>;
+    clock = <&xclk 0>;
+    interrupt-parent = <&L4>;
+    interrupts = <32>, <33>;
+    status = "okay";
+};
+#endif
 
-	uioinst->irq = irq;
-	uioinst->regstart = regstart;
-	uioinst->regsize = regsize;
+#else
 
-	if (!regstart) {
-		uioinst->memalloc = kzalloc(regsize, GFP_KERNEL | GFP_DMA);
-		printk(KERN_INFO "memalloc %px, pa=%px, size=%u bytes\n",
-				(void*) uioinst->memalloc, (void*) __pa(uioinst->memalloc),
-				(unsigned int) regsize);
-		if (!uioinst->memalloc) {
-			printk(KERN_WARNING "Failing to allocate mappable memory\n");
-			error = -ENOMEM;
-			goto exit_func;
-		}
-		/* use physical address mapping so that
-		 * pgprot_noncached() and remap_pfn_range()
-		 * are called by uio core.
-		 * */
-		uiomem->addr = (phys_addr_t) __pa(uioinst->memalloc);
-	} else {
-		printk(KERN_INFO "regstart %px, pa=%px, size=%u bytes\n",
-				(void*) regstart, (void*) __pa(regstart), (unsigned int) regsize);
-		uiomem->addr = (phys_addr_t)(regstart);
-	}
-	uiomem->memtype = UIO_MEM_PHYS;
+static void simpledriver_release(struct device *dev) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	pr_debug("releasing vdw uio device\n");
+	kfree_rcu(uioinst, rcu);
+}
 
-	printk(KERN_INFO "uiomem->addr = %px\n", (void*) uiomem->addr);
-	printk(KERN_INFO "uiomem->size = %u\n", (unsigned int) uiomem->size);
-	printk(KERN_INFO "uiomem->memtype = %s\n", (uiomem->memtype==UIO_MEM_PHYS)?"UIO_MEM_PHYS":"UIO_MEM_LOGICAL");
+/*! registry lookup, never blocks on instances being added or removed
+ * @return instance with a device reference held, release it with
+ * simpledriver_instance_put(), or 0 when there is no such instance
+ */
+static vdw_uio_dev_priv_ptr simpledriver_instance_get(u32 id) {
+	vdw_uio_dev_priv_ptr uioinst;
+	rcu_read_lock();
+	uioinst = xa_load(&module.instances, id);
+	if (uioinst && !kobject_get_unless_zero(&uioinst->dev.kobj)) {
+		uioinst = 0;
+	}
+	rcu_read_unlock();
+	return uioinst;
+}
 
-	uioinst->info.mem[1].size = 0; // sentinel, we only use 1 mapped region
+static void simpledriver_instance_put(vdw_uio_dev_priv_ptr uioinst) {
+	put_device(&uioinst->dev);
+}
 
-	if (uio_register_device(&uioinst->dev, &uioinst->info) < 0) {
-		printk(KERN_INFO "Failing to register uio device\n");
-		error = -ENODEV;
-		goto exit_func;
+/* release the instance region, counterpart of the allocation done in
+ * simpledriver_instance_init (device must still be referenced)
+ */
+static void simpledriver_memfree(vdw_uio_dev_priv_ptr uioinst) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+	if (uioinst->memcma) {
+		dma_free_pages(&uioinst->dev, uioinst->regsize, uioinst->mempages,
+				uioinst->memdma, DMA_BIDIRECTIONAL);
+		uioinst->mempages = 0;
+		uioinst->memalloc = 0;
+		uioinst->memdma = 0;
+		uioinst->memcma = false;
+		return;
+	}
+#endif
+	if (!uioinst->memalloc) {
+		return;
+	}
+	if (uioinst->memdma) {
+		dma_unmap_single(&uioinst->dev, uioinst->memdma, uioinst->regsize,
+				DMA_BIDIRECTIONAL);
+	}
+	if (uioinst->backend == VDW_ALLOC_CONTIG
+			|| uioinst->mapmode == VDW_MAP_CACHED) {
+		free_pages_exact(uioinst->memalloc, uioinst->regsize);
 	} else {
-		printk(KERN_INFO "Registered UIO handler for IRQ=%d\n", (int) uioinst->info.irq);
-		error = 0;
+		kfree(uioinst->memalloc);
 	}
+	uioinst->memalloc = 0;
+	uioinst->mempages = 0;
+	uioinst->memdma = 0;
+}
 
-	exit_func: if (error) {
-		if (uioinst) {
-			if (devregistered) {
-				device_unregister(&uioinst->dev);
-			}
-			kfree(uioinst->memalloc);
-			kfree(uioinst);
-			if (module.uioinst == uioinst) {
-				module.uioinst = 0;
-				module.instancecount = 0;
-			}
-		}
+/* first page of kernel allocated instance memory, 0 for device memory */
+static struct page *vdw_mem_page(vdw_uio_dev_priv_ptr uioinst) {
+	if (uioinst->mempages) {
+		return uioinst->mempages;
 	}
-	return error;
+	return uioinst->memalloc ? virt_to_page(uioinst->memalloc) : 0;
 }
 
-static int simpledriver_instance_add(const char* params)
-{
-	int error = 0;
-	int irqparam;
-	uintptr_t regstartparam;
-	uint32_t regsizeparam;
-	int sscanfret;
-	char reststring[256];
+/* drop one reference on the instance region, see vdw_dmabuf_export() */
+static void simpledriver_memput(vdw_uio_dev_priv_ptr uioinst) {
+	if (refcount_dec_and_test(&uioinst->memrefs)) {
+		simpledriver_memfree(uioinst);
+	}
+}
 
-	printk( KERN_NOTICE "vdw-driver simpledriver_instance_add, regions (irq,start,size[,...]) = %s\n",
-			params?params:"NULL");
+/* kernel allocated regions stay below 4 GB (zone, the low zones only
+ * exist on the first node(s)) unless the instance is placed on a node,
+ * then they come from that node wherever it is and the dma mask is
+ * widened so the streaming mapping does not bounce through swiotlb
+ */
+static gfp_t vdw_mem_zone(vdw_uio_dev_priv_ptr uioinst, gfp_t zone) {
+	return uioinst->node == NUMA_NO_NODE ? zone : 0;
+}
 
-	if (!params || !strlen(params)) return -1;
+static u64 vdw_mem_dmamask(vdw_uio_dev_priv_ptr uioinst) {
+	return uioinst->node == NUMA_NO_NODE ? DMA_BIT_MASK(32) : DMA_BIT_MASK(64);
+}
 
-	memset(reststring, 0, sizeof(reststring));
-	strncpy(reststring, params, sizeof(reststring) - 1);
-	do {
-		sscanfret = sscanf(reststring, "%d,%lx,%u%s", &irqparam, &regstartparam,
-				&regsizeparam, reststring);
-		printk(KERN_INFO "sscanfret %d, irqparam %d, regstartparam %lx, regsizeparam %u, rest = %s\r\n",
-				sscanfret, irqparam, regstartparam, regsizeparam, reststring);
-		error = -1;
-		if (sscanfret >= 3) {
-			error = simpledriver_instance_init(irqparam, regstartparam, regsizeparam);
-		}
-		if (error) { // either sscanf failed or instance_init
-			break;
-		}
-		if (reststring[0] == ',') {
-			memmove(reststring, reststring + 1, strlen(reststring));
+/* physically contiguous region for the "contig" backend: a high-order
+ * page allocation when the buddy allocator can serve the size, otherwise
+ * the dma layer, which takes large regions from CMA
+ * both stay inside the dma mask, see vdw_mem_zone(), so the streaming
+ * mapping never bounces through swiotlb and memdma is the region itself
+ */
+static int simpledriver_contigalloc(vdw_uio_dev_priv_ptr uioinst) {
+	uioinst->memalloc = alloc_pages_exact_nid(uioinst->node, uioinst->regsize,
+			GFP_KERNEL | vdw_mem_zone(uioinst, GFP_DMA32) | __GFP_ZERO
+					| __GFP_NOWARN);
+	if (uioinst->memalloc) {
+		uioinst->mempages = virt_to_page(uioinst->memalloc);
+		uioinst->memdma = dma_map_single(&uioinst->dev, uioinst->memalloc,
+				uioinst->regsize, DMA_BIDIRECTIONAL);
+		if (dma_mapping_error(&uioinst->dev, uioinst->memdma)) {
+			printk(KERN_ERR "contig: cannot map %u bytes for cache sync\n",
+					uioinst->regsize);
+			uioinst->memdma = 0;
+			return -ENOMEM;
 		}
-		else { // no valid reststring
-			break;
+		return 0;
+	}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+	uioinst->mempages = dma_alloc_pages(&uioinst->dev, uioinst->regsize,
+			&uioinst->memdma, DMA_BIDIRECTIONAL, GFP_KERNEL | __GFP_NOWARN);
+	if (uioinst->mempages) {
+		uioinst->memcma = true;
+		uioinst->memalloc = page_address(uioinst->mempages);
+		if (uioinst->memalloc) {
+			memset(uioinst->memalloc, 0, uioinst->regsize);
 		}
-	} while (sscanfret > 3);
+		return 0;
+	}
+#endif
 
-	return error;
+	printk(KERN_ERR "contig: cannot allocate %u physically contiguous bytes "
+			"(order %u), buddy allocator and CMA exhausted, "
+			"reserve a larger CMA area (cma=) or use a smaller region\n",
+			uioinst->regsize, get_order(uioinst->regsize));
+	return -ENOMEM;
 }
 
-static int simpledriver_init(void) {
-	printk( KERN_NOTICE "vdw-driver init\n");
-	return simpledriver_instance_add(devregions);
+static inline void vdw_vm_flags_set(struct vm_area_struct *vma,
+		vm_flags_t flags) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_set(vma, flags);
+#else
+	vma->vm_flags |= flags;
+#endif
 }
 
-static void simpledriver_exit(void) {
-	vdw_uio_dev_priv_ptr uioinst = module.uioinst;
-	vdw_uio_dev_priv_ptr uioinstnext;
-	printk( KERN_NOTICE "vdw-driver exit begin, %d instances\n", module.instancecount);
-	while (uioinst) {
-		uioinstnext = uioinst->pnext;
-		printk(KERN_INFO "UnRegister UIO handler for IRQ=%d name=%s\n",
-				(int) uioinst->info.irq,
-				uioinst->info.name);
-		uio_unregister_device(&uioinst->info);
-		device_unregister(&uioinst->dev);
-		kfree(uioinst->memalloc);
-		kfree(uioinst);
-		uioinst = uioinstnext;
-		--module.instancecount;
+static inline void vdw_vm_flags_clear(struct vm_area_struct *vma,
+		vm_flags_t flags) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_clear(vma, flags);
+#else
+	vma->vm_flags &= ~flags;
+#endif
+}
+
+/* the event ring and the snapshot page are written by the driver only,
+ * readers rely on their sequence counters, refuse writable mappings and
+ * keep mprotect() from adding write access later
+ */
+static int vdw_vm_readonly(struct vm_area_struct *vma) {
+	if (vma->vm_flags & VM_WRITE) {
+		return -EPERM;
 	}
-	printk( KERN_NOTICE "vdw-driver exit done, %d instances\n", module.instancecount);
+	vdw_vm_flags_clear(vma, VM_MAYWRITE);
+	return 0;
 }
 
-/* GBO: either use probe or this, not both */
-module_init( simpledriver_init);
-module_exit( simpledriver_exit);
+static vm_fault_t vdw_vm_fault(struct vm_fault *vmf) {
+	vdw_uio_dev_priv_ptr uioinst = vmf->vma->vm_private_data;
+	unsigned long offset = vmf->address - vmf->vma->vm_start;
+
+	if (offset >= uioinst->regsize) {
+		return VM_FAULT_SIGBUS;
+	}
+	return vmf_insert_pfn(vmf->vma, vmf->address & PAGE_MASK,
+			page_to_pfn(uioinst->mempages) + (offset >> PAGE_SHIFT));
+}
+
+#if defined(CONFIG_TRANSPARENT_HUGEPAGE)
+/* map a whole PMD when both the user address and the physical address
+ * are PMD aligned and the region covers it, else fall back to 4k pages
+ */
+static vm_fault_t vdw_vm_fault_pmd(struct vm_fault *vmf) {
+	struct vm_area_struct *vma = vmf->vma;
+	vdw_uio_dev_priv_ptr uioinst = vma->vm_private_data;
+	unsigned long pmdaddr = vmf->address & PMD_MASK;
+	unsigned long offset = pmdaddr - vma->vm_start;
+	unsigned long pfn;
+
+	if (pmdaddr < vma->vm_start || pmdaddr + PMD_SIZE > vma->vm_end
+			|| offset + PMD_SIZE > uioinst->regsize) {
+		return VM_FAULT_FALLBACK;
+	}
+	pfn = page_to_pfn(uioinst->mempages) + (offset >> PAGE_SHIFT);
+	if (pfn & ((PMD_SIZE >> PAGE_SHIFT) - 1)) {
+		return VM_FAULT_FALLBACK;
+	}
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 17, 0)
+	return vmf_insert_pfn_pmd(vmf, pfn, vmf->flags & FAULT_FLAG_WRITE);
+#else
+	return vmf_insert_pfn_pmd(vmf, __pfn_to_pfn_t(pfn, PFN_DEV),
+			vmf->flags & FAULT_FLAG_WRITE);
+#endif
+}
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+static vm_fault_t vdw_vm_huge_fault(struct vm_fault *vmf, unsigned int order) {
+	if (order == PMD_SHIFT - PAGE_SHIFT) {
+		return vdw_vm_fault_pmd(vmf);
+	}
+	return VM_FAULT_FALLBACK;
+}
+#else
+static vm_fault_t vdw_vm_huge_fault(struct vm_fault *vmf,
+		enum page_entry_size pe_size) {
+	if (pe_size == PE_SIZE_PMD) {
+		return vdw_vm_fault_pmd(vmf);
+	}
+	return VM_FAULT_FALLBACK;
+}
+#endif
 #endif
 
-MODULE_AUTHOR("Gert Boddaert");
-MODULE_DESCRIPTION("Userspace I/O platform driver with IRQ handling for VDW");
-MODULE_LICENSE("GPL v2");
-MODULE_ALIAS("platform:" DRV_NAME);
+static const struct vm_operations_struct vdw_vm_ops = {
+	.fault = vdw_vm_fault,
+#if defined(CONFIG_TRANSPARENT_HUGEPAGE)
+	.huge_fault = vdw_vm_huge_fault,
+#endif
+};
+
+static pgprot_t vdw_uio_pgprot(vdw_uio_mapmode mapmode, pgprot_t prot) {
+	switch (mapmode) {
+	case VDW_MAP_CACHED:
+		return prot;
+	case VDW_MAP_WC:
+		return pgprot_writecombine(prot);
+	default:
+		return pgprot_noncached(prot);
+	}
+}
+
+/* mmap of every instance, the uio core would map all UIO_MEM_PHYS
+ * regions uncached and "contig" regions with remap_pfn_range(), which
+ * never uses PMD sized pages; "maps=" windows are device memory and get
+ * the region's mode, except "cached", which only suits kernel memory
+ * the uio core has already checked the map index and the size
+ */
+static int vdw_uio_mmap_region(struct uio_info *info,
+		struct vm_area_struct *vma) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(info, vdw_uio_dev_priv, info);
+	struct uio_mem *uiomem = &info->mem[0];
+	vdw_uio_mapmode winmode;
+	unsigned long window;
+	unsigned long pfn;
+
+	if (vma->vm_pgoff == VDW_EVENTRING_MAP && uioinst->ring) {
+		if (vdw_vm_readonly(vma)) {
+			return -EPERM;
+		}
+		// cacheable kernel pages, same as uio core does for UIO_MEM_LOGICAL
+		return remap_pfn_range(vma, vma->vm_start,
+				virt_to_phys(uioinst->ring) >> PAGE_SHIFT,
+				vma->vm_end - vma->vm_start, vma->vm_page_prot);
+	}
+	if (vma->vm_pgoff == VDW_SNAPSHOT_MAP && uioinst->snap.page) {
+		if (vdw_vm_readonly(vma)) {
+			return -EPERM;
+		}
+		return remap_pfn_range(vma, vma->vm_start,
+				virt_to_phys(uioinst->snap.page) >> PAGE_SHIFT,
+				vma->vm_end - vma->vm_start, vma->vm_page_prot);
+	}
+	window = vma->vm_pgoff - vdw_uio_windowmap(uioinst->snap.size);
+	if (vma->vm_pgoff != 0 && window >= uioinst->nwindows) {
+		return -EINVAL;
+	}
+	if (vma->vm_pgoff != 0) {
+		winmode = (uioinst->mapmode == VDW_MAP_CACHED) ?
+				VDW_MAP_UNCACHED : uioinst->mapmode;
+		vma->vm_page_prot = vdw_uio_pgprot(winmode, vma->vm_page_prot);
+		return io_remap_pfn_range(vma, vma->vm_start,
+				uioinst->windows[window].start >> PAGE_SHIFT,
+				vma->vm_end - vma->vm_start, vma->vm_page_prot);
+	}
+	vma->vm_page_prot = vdw_uio_pgprot(uioinst->mapmode, vma->vm_page_prot);
+
+	if (uioinst->mempages) {
+		if (!(vma->vm_flags & VM_SHARED)) {
+			return -EINVAL; // pfn mappings cannot be copy-on-write
+		}
+		vdw_vm_flags_set(vma, VM_PFNMAP | VM_IO | VM_DONTEXPAND | VM_DONTDUMP
+				| VM_HUGEPAGE);
+		vma->vm_private_data = uioinst;
+		vma->vm_ops = &vdw_vm_ops;
+		return 0;
+	}
+
+	if (uiomem->memtype == UIO_MEM_LOGICAL) {
+		pfn = virt_to_phys((void*) (uintptr_t) uiomem->addr) >> PAGE_SHIFT;
+		return remap_pfn_range(vma, vma->vm_start, pfn,
+				vma->vm_end - vma->vm_start, vma->vm_page_prot);
+	}
+	pfn = uiomem->addr >> PAGE_SHIFT;
+	if (uioinst->regstart) {
+		return io_remap_pfn_range(vma, vma->vm_start, pfn,
+				vma->vm_end - vma->vm_start, vma->vm_page_prot);
+	}
+	return remap_pfn_range(vma, vma->vm_start, pfn,
+			vma->vm_end - vma->vm_start, vma->vm_page_prot);
+}
+
+static int vdw_uio_mmap(struct uio_info *info, struct vm_area_struct *vma) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(info, vdw_uio_dev_priv, info);
+	int ret = vdw_uio_mmap_region(info, vma);
+	bool kernelpages = vma->vm_pgoff == VDW_EVENTRING_MAP
+			|| (vma->vm_pgoff == VDW_SNAPSHOT_MAP && uioinst->snap.page);
+	trace_vdw_mmap(uioinst->id, vma->vm_pgoff, vma->vm_end - vma->vm_start,
+			kernelpages ? -1 : (int) uioinst->mapmode, ret);
+	return ret;
+}
+
+/*! "sync" instance attribute, /sys/class/uio/uioX/device/sync
+ * @param sync
+ * flush|invalidate[,offset,size]
+ * flush: make cpu writes visible to the device
+ * invalidate: make device writes visible to the cpu
+ * offset and size are HEX, without them the whole region is synced
+ */
+static ssize_t sync_store(struct device *dev, struct device_attribute *attr,
+		const char *buf, size_t count) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	char op[16];
+	unsigned long offset = 0;
+	unsigned long size = 0;
+	int sscanfret;
+
+	if (uioinst->mapmode != VDW_MAP_CACHED || !uioinst->memdma) {
+		return -EPERM; // uncached mappings are always coherent
+	}
+
+	sscanfret = sscanf(buf, "%15[a-z],%lx,%lx", op, &offset, &size);
+	if (sscanfret < 1) {
+		return -EINVAL;
+	}
+	if (sscanfret < 3) {
+		offset = 0;
+		size = uioinst->regsize;
+	}
+	if (offset >= uioinst->regsize || size > uioinst->regsize - offset) {
+		return -EINVAL;
+	}
+
+	if (!strcmp(op, "flush")) {
+		dma_sync_single_range_for_device(&uioinst->dev, uioinst->memdma,
+				offset, size, DMA_BIDIRECTIONAL);
+	} else if (!strcmp(op, "invalidate")) {
+		dma_sync_single_range_for_cpu(&uioinst->dev, uioinst->memdma,
+				offset, size, DMA_BIDIRECTIONAL);
+	} else {
+		return -EINVAL;
+	}
+	return count;
+}
+static DEVICE_ATTR_WO(sync);
+
+static ssize_t mapmode_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	return sprintf(buf, "%s\n", mapmodenames[uioinst->mapmode]);
+}
+static DEVICE_ATTR_RO(mapmode);
+
+/* the event ring of mem[VDW_EVENTRING_MAP], see uio_vdw.h */
+static int simpledriver_ringalloc(vdw_uio_dev_priv_ptr uioinst) {
+	struct uio_mem *uiomem = &uioinst->info.mem[VDW_EVENTRING_MAP];
+
+	raw_spin_lock_init(&uioinst->ringlock);
+	uioinst->ringsize = PAGE_ALIGN(sizeof(vdw_uio_eventring)
+			+ VDW_EVENTRING_ENTRIES * sizeof(vdw_uio_event));
+	uioinst->ring = alloc_pages_exact_nid(uioinst->node, uioinst->ringsize,
+			GFP_KERNEL | __GFP_ZERO);
+	if (!uioinst->ring) {
+		printk(KERN_WARNING "Failing to allocate event ring\n");
+		return -ENOMEM;
+	}
+	uioinst->ring->version = VDW_EVENTRING_VERSION;
+	uioinst->ring->entries = VDW_EVENTRING_ENTRIES;
+
+	uiomem->addr = (phys_addr_t) (uintptr_t) uioinst->ring;
+	uiomem->size = uioinst->ringsize;
+	uiomem->offs = 0;
+	uiomem->memtype = UIO_MEM_LOGICAL;
+	uiomem->name = uioinst->mapnames[VDW_EVENTRING_MAP];
+	scnprintf(uioinst->mapnames[VDW_EVENTRING_MAP], VDW_NAMELEN, "%s_events",
+			uioinst->info.name);
+	return 0;
+}
+
+static void simpledriver_ringfree(vdw_uio_dev_priv_ptr uioinst) {
+	if (uioinst->ring) {
+		free_pages_exact(uioinst->ring, uioinst->ringsize);
+		uioinst->ring = 0;
+	}
+}
+
+/* the register snapshot page of mem[VDW_SNAPSHOT_MAP], see uio_vdw.h */
+static int simpledriver_snapalloc(vdw_uio_dev_priv_ptr uioinst,
+		const vdw_uio_params *params) {
+	struct uio_mem *uiomem = &uioinst->info.mem[VDW_SNAPSHOT_MAP];
+	vdw_uio_snap *snap = &uioinst->snap;
+
+	snap->offset = params->snapoffset;
+	snap->size = params->snapsize;
+	snap->periodus = params->snapus;
+	snap->pagesize = PAGE_ALIGN(sizeof(vdw_uio_snapshot) + snap->size);
+	snap->page = alloc_pages_exact_nid(uioinst->node, snap->pagesize,
+			GFP_KERNEL | __GFP_ZERO);
+	if (!snap->page) {
+		printk(KERN_WARNING "Failing to allocate snapshot page\n");
+		snap->size = 0;
+		return -ENOMEM;
+	}
+	snap->page->version = VDW_SNAPSHOT_VERSION;
+	snap->page->size = snap->size;
+	snap->page->offset = snap->offset;
+
+	uiomem->addr = (phys_addr_t) (uintptr_t) snap->page;
+	uiomem->size = snap->pagesize;
+	uiomem->offs = 0;
+	uiomem->memtype = UIO_MEM_LOGICAL;
+	uiomem->name = uioinst->mapnames[VDW_SNAPSHOT_MAP];
+	scnprintf(uioinst->mapnames[VDW_SNAPSHOT_MAP], VDW_NAMELEN, "%s_snapshot",
+			uioinst->info.name);
+	return 0;
+}
+
+static void simpledriver_snapfree(vdw_uio_dev_priv_ptr uioinst) {
+	if (uioinst->snap.page) {
+		free_pages_exact(uioinst->snap.page, uioinst->snap.pagesize);
+		uioinst->snap.page = 0;
+	}
+}
+
+/* publish one event in the ring, single producer per instance thanks to
+ * ringlock, consumers only ever read (see vdw_eventring_read())
+ */
+static void vdw_eventring_push(vdw_uio_dev_priv_ptr uioinst,
+		const u32 *regs, u32 nregs, u32 line) {
+	vdw_uio_eventring *ring = uioinst->ring;
+	vdw_uio_event *slot;
+	unsigned long flags;
+	u64 seq;
+
+	if (!ring) {
+		return;
+	}
+	raw_spin_lock_irqsave(&uioinst->ringlock, flags);
+	seq = ++uioinst->ringseq;
+	slot = &ring->ring[(seq - 1) & (VDW_EVENTRING_ENTRIES - 1)];
+	WRITE_ONCE(slot->seq, 0);
+	smp_wmb();
+	slot->timestamp = ktime_get_ns();
+	slot->cpu = raw_smp_processor_id();
+	slot->nregs = nregs;
+	slot->line = line;
+	if (nregs) {
+		memcpy(slot->regs, regs, nregs * sizeof(*regs));
+	}
+	smp_wmb();
+	WRITE_ONCE(slot->seq, seq);
+	smp_store_release(&ring->counter, seq);
+	raw_spin_unlock_irqrestore(&uioinst->ringlock, flags);
+}
+
+static inline void vdw_timer_setup(struct hrtimer *timer,
+		enum hrtimer_restart (*function)(struct hrtimer *),
+		enum hrtimer_mode mode) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(timer, function, CLOCK_MONOTONIC, mode);
+#else
+	hrtimer_init(timer, CLOCK_MONOTONIC, mode);
+	timer->function = function;
+#endif
+}
+
+/* hand merged events to userspace with one wakeup, uio keeps a plain
+ * counter, so adding the merged events to it first accounts for every
+ * one of them in the value read() returns
+ */
+static void vdw_uio_notify(vdw_uio_dev_priv_ptr uioinst, u32 events) {
+	trace_vdw_notify(uioinst->id, events);
+	if (!events) {
+		return;
+	}
+	if (events > 1) {
+		atomic_add(events - 1, &uioinst->info.uio_dev->event);
+	}
+	uio_event_notify(&uioinst->info);
+}
+
+/* event rate over the last window, switches between irq and poll mode,
+ * called with moder.lock held
+ */
+static void vdw_moder_rate(vdw_uio_moder *moder, u32 newevents) {
+	u64 now = ktime_get_ns();
+	u64 elapsed = now - moder->windowstart;
+	u64 rate;
+
+	moder->windowevents += newevents;
+	if (elapsed < VDW_MODER_WINDOW_NS) {
+		return;
+	}
+	rate = div64_u64((u64) moder->windowevents * NSEC_PER_SEC, elapsed);
+	if (moder->highrate && !moder->pollmode && rate >= moder->highrate) {
+		moder->pollmode = true;
+		++moder->pollswitches;
+	} else if (moder->pollmode && (!moder->highrate || rate <= moder->lowrate)) {
+		moder->pollmode = false;
+		++moder->pollswitches;
+	}
+	moder->windowstart = now;
+	moder->windowevents = 0;
+}
+
+static enum hrtimer_restart vdw_moder_timer(struct hrtimer *timer) {
+	vdw_uio_moder *moder = container_of(timer, vdw_uio_moder, timer);
+	vdw_uio_dev_priv_ptr uioinst = container_of(moder, vdw_uio_dev_priv, moder);
+	unsigned long flags;
+	u32 events;
+	bool restart;
+
+	u32 pollus;
+
+	raw_spin_lock_irqsave(&moder->lock, flags);
+	events = moder->pending;
+	moder->pending = 0;
+	if (events) {
+		++moder->notifies;
+	}
+	vdw_moder_rate(moder, 0);
+	restart = moder->pollmode;
+	pollus = moder->pollus;
+	raw_spin_unlock_irqrestore(&moder->lock, flags);
+
+	vdw_uio_notify(uioinst, events);
+	if (restart) {
+		hrtimer_forward_now(timer, us_to_ktime(pollus));
+		return HRTIMER_RESTART;
+	}
+	return HRTIMER_NORESTART;
+}
+
+/* one interrupt claimed by vdw_uio_handler, decide when to wake userspace */
+static void vdw_moder_event(vdw_uio_dev_priv_ptr uioinst) {
+	vdw_uio_moder *moder = &uioinst->moder;
+	unsigned long flags;
+	u32 events = 0;
+
+	raw_spin_lock_irqsave(&moder->lock, flags);
+	++moder->events;
+	++moder->pending;
+	vdw_moder_rate(moder, 1);
+	if (moder->pollmode) {
+		if (!hrtimer_active(&moder->timer)) {
+			hrtimer_start(&moder->timer, us_to_ktime(moder->pollus),
+					HRTIMER_MODE_REL);
+		}
+	} else if (moder->pending >= max(moder->maxevents, 1U)) {
+		events = moder->pending;
+		moder->pending = 0;
+		++moder->notifies;
+		/* under the lock: a deadline armed by the next event on
+		 * another cpu must not be the one cancelled here
+		 */
+		if (moder->maxdelayus) {
+			hrtimer_try_to_cancel(&moder->timer);
+		}
+	} else if (moder->pending == 1 && moder->maxdelayus) {
+		hrtimer_start(&moder->timer, us_to_ktime(moder->maxdelayus),
+				HRTIMER_MODE_REL);
+	}
+	raw_spin_unlock_irqrestore(&moder->lock, flags);
+
+	if (events) {
+		vdw_uio_notify(uioinst, events);
+	}
+}
+
+/* change one moderation parameter, events pending in irq mode are
+ * handed over right away, they were queued for a threshold or deadline
+ * that may no longer apply; poll mode picks it up on the next period
+ */
+static void vdw_moder_set(vdw_uio_dev_priv_ptr uioinst, u32 *field,
+		u32 value) {
+	vdw_uio_moder *moder = &uioinst->moder;
+	unsigned long flags;
+	u32 events = 0;
+
+	raw_spin_lock_irqsave(&moder->lock, flags);
+	*field = value;
+	if (!moder->pollmode && moder->pending) {
+		events = moder->pending;
+		moder->pending = 0;
+		++moder->notifies;
+		hrtimer_try_to_cancel(&moder->timer);
+	}
+	raw_spin_unlock_irqrestore(&moder->lock, flags);
+
+	if (events) {
+		vdw_uio_notify(uioinst, events);
+	}
+}
+
+static void vdw_moder_init(vdw_uio_moder *moder) {
+	raw_spin_lock_init(&moder->lock);
+	vdw_timer_setup(&moder->timer, vdw_moder_timer, HRTIMER_MODE_REL);
+	moder->maxevents = 1;
+	moder->pollus = VDW_MODER_POLL_US;
+	moder->windowstart = ktime_get_ns();
+}
+
+static inline void vdw_eventfd_kick(struct eventfd_ctx *ctx) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	eventfd_signal(ctx);
+#else
+	eventfd_signal(ctx, 1);
+#endif
+}
+
+/* wake the eventfds that asked for one of the cause bits, or for every
+ * event, and for this line or every line, no eventfds costs one pointer
+ * load
+ */
+static void vdw_eventfd_signal(vdw_uio_dev_priv_ptr uioinst, u32 cause,
+		u32 line) {
+	const vdw_uio_efds *efds;
+	u32 iter;
+
+	rcu_read_lock();
+	efds = rcu_dereference(uioinst->efds);
+	for (iter = 0; efds && iter < efds->count; iter++) {
+		if ((!efds->entry[iter].mask || (efds->entry[iter].mask & cause))
+				&& (!efds->entry[iter].lines
+				|| (efds->entry[iter].lines & BIT(line)))) {
+			vdw_eventfd_kick(efds->entry[iter].ctx);
+			atomic64_inc(&uioinst->eventfdsignals);
+		}
+	}
+	rcu_read_unlock();
+}
+
+/* one claimed event, timestamped in the ring before userspace is told,
+ * regs are the registers captured for it, cause the "cause=" bits and
+ * line the interrupt line it came in on (0 for software events)
+ */
+static void vdw_uio_event(vdw_uio_dev_priv_ptr uioinst, const u32 *regs,
+		u32 nregs, u32 cause, u32 line) {
+	atomic64_inc(&uioinst->irqcounts[line]);
+	vdw_eventring_push(uioinst, regs, nregs, line);
+	vdw_eventfd_signal(uioinst, cause, line);
+	vdw_moder_event(uioinst);
+}
+
+static u32 vdw_reg_read(vdw_uio_dev_priv_ptr uioinst, u32 offset) {
+	if (uioinst->regbase) {
+		return readl(uioinst->regbase + offset);
+	}
+	return READ_ONCE(*(u32*) ((u8*) uioinst->memalloc + offset));
+}
+
+/* kernel memory emulates write-1-to-clear */
+static void vdw_reg_ack(vdw_uio_dev_priv_ptr uioinst, u32 offset, u32 bits) {
+	u32 *reg;
+	if (uioinst->regbase) {
+		writel(bits, uioinst->regbase + offset);
+		return;
+	}
+	reg = (u32*) ((u8*) uioinst->memalloc + offset);
+	WRITE_ONCE(*reg, READ_ONCE(*reg) & ~bits);
+}
+
+/* is the interrupt ours, read the pending register when there is one
+ * the value read is handed on in *status so capture does not read it again
+ */
+static bool vdw_uio_pending(vdw_uio_dev_priv_ptr uioinst, u32 *status) {
+	const vdw_uio_regs *desc = &uioinst->regs;
+	if (!desc->pendingmask) {
+		return true;
+	}
+	*status = vdw_reg_read(uioinst, desc->pendingoffset);
+	return *status & desc->pendingmask;
+}
+
+/* snapshot the "capture" registers and ack the device before the line
+ * is released, so userspace gets the status that raised the interrupt
+ * without a register read of its own
+ * the cause bits are taken before the ack as well, into *cause
+ * @return number of registers captured into regs
+ */
+static u32 vdw_uio_capture(vdw_uio_dev_priv_ptr uioinst, u32 status,
+		u32 *regs, u32 *cause) {
+	const vdw_uio_regs *desc = &uioinst->regs;
+	u32 iter;
+
+	for (iter = 0; iter < desc->ncapture; iter++) {
+		regs[iter] = ((int) iter == uioinst->pendingindex) ? status :
+				vdw_reg_read(uioinst, desc->capture[iter]);
+	}
+	if (desc->causemask) {
+		if (uioinst->causeindex >= 0) {
+			*cause = regs[uioinst->causeindex];
+		} else if (desc->pendingmask && desc->causeoffset == desc->pendingoffset) {
+			*cause = status;
+		} else {
+			*cause = vdw_reg_read(uioinst, desc->causeoffset);
+		}
+		*cause &= desc->causemask;
+	}
+	if (desc->ackmask) {
+		// only the bits seen, a cause raised since stays pending
+		u32 bits = desc->ackmask;
+		if (uioinst->ackindex >= 0) {
+			bits &= regs[uioinst->ackindex];
+		} else if (desc->pendingmask && desc->ackoffset == desc->pendingoffset) {
+			bits &= status;
+		}
+		vdw_reg_ack(uioinst, desc->ackoffset, bits);
+		atomic64_inc(&uioinst->acks);
+	}
+	return desc->ncapture;
+}
+
+/* copy the snapshot range, seq is odd while the copy is in progress
+ * readers never block the writer, they retry instead
+ * one writer at a time, see vdw_snapshot_take() and vdw_snap_timer()
+ */
+static void vdw_snapshot_copy(vdw_uio_dev_priv_ptr uioinst) {
+	vdw_uio_snap *snap = &uioinst->snap;
+	vdw_uio_snapshot *page = snap->page;
+	u32 iter;
+
+	WRITE_ONCE(page->seq, page->seq + 1);
+	smp_wmb();
+	for (iter = 0; iter < snap->size / 4; iter++) {
+		page->data[iter] = vdw_reg_read(uioinst, snap->offset + iter * 4);
+	}
+	page->timestamp = ktime_get_ns();
+	++page->count;
+	smp_wmb();
+	WRITE_ONCE(page->seq, page->seq + 1);
+}
+
+/* snapshot on a claimed interrupt, handlers of different lines may run
+ * at once; the range is at most VDW_SNAP_IRQ_MAX bytes
+ */
+static void vdw_snapshot_take(vdw_uio_dev_priv_ptr uioinst) {
+	unsigned long flags;
+	raw_spin_lock_irqsave(&uioinst->snap.lock, flags);
+	vdw_snapshot_copy(uioinst);
+	raw_spin_unlock_irqrestore(&uioinst->snap.lock, flags);
+}
+
+/* periodic snapshot, soft timer and the only writer: a long range is
+ * copied in softirq context without a lock, interrupts stay on
+ */
+static enum hrtimer_restart vdw_snap_timer(struct hrtimer *timer) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(timer, vdw_uio_dev_priv,
+			snap.timer);
+	vdw_snapshot_copy(uioinst);
+	hrtimer_forward_now(timer, us_to_ktime(uioinst->snap.periodus));
+	return HRTIMER_RESTART;
+}
+
+static void vdw_snap_start(vdw_uio_dev_priv_ptr uioinst) {
+	if (uioinst->snap.size && uioinst->snap.periodus) {
+		hrtimer_start(&uioinst->snap.timer,
+				us_to_ktime(uioinst->snap.periodus), HRTIMER_MODE_REL_SOFT);
+	}
+}
+
+/* line index of irq, lines besides the first only with "irqs=", a line
+ * is in irqs[] before it is requested, unused entries are 0
+ */
+static inline u32 vdw_irq_line(vdw_uio_dev_priv_ptr uioinst, int irq) {
+	int line;
+	for (line = 1; line < VDW_MAXIRQS && uioinst->irqs[line]; line++) {
+		if (uioinst->irqs[line] == irq) {
+			return line;
+		}
+	}
+	return 0;
+}
+
+/* mask or unmask every line of the instance, one disable depth level
+ * each; nosync from the handler, which must not wait for itself
+ * maskedlines remembers how many were requested at the time, lines are
+ * still being added while the first one may already fire
+ */
+static void vdw_irq_disable_lines(vdw_uio_dev_priv_ptr uioinst, bool nosync) {
+	int nirqs = READ_ONCE(uioinst->nirqs);
+	int line;
+	for (line = 0; line < nirqs; line++) {
+		if (nosync) {
+			disable_irq_nosync(uioinst->irqs[line]);
+		} else {
+			disable_irq(uioinst->irqs[line]);
+		}
+	}
+	uioinst->maskedlines = nirqs;
+}
+
+static void vdw_irq_enable_lines(vdw_uio_dev_priv_ptr uioinst) {
+	int line;
+	for (line = 0; line < uioinst->maskedlines; line++) {
+		enable_irq(uioinst->irqs[line]);
+	}
+}
+
+/* interrupt entry for driver owned irqs, the pending register and then
+ * vdw_uio_handler decide whether the interrupt is ours, moderation
+ * decides when userspace gets it
+ * declining costs one register read, a sharer's interrupt no longer
+ * wakes, masks or acks this instance
+ */
+static irqreturn_t vdw_uio_irq(int irq, void *dev_id) {
+	vdw_uio_dev_priv_ptr uioinst = dev_id;
+	u64 start = trace_vdw_irq_exit_enabled() ? ktime_get_ns() : 0;
+	irqreturn_t ret = IRQ_NONE;
+	u32 regs[VDW_EVENT_REGS];
+	u32 status = 0;
+	u32 cause = 0;
+	u32 nregs;
+	u32 line;
+
+	trace_vdw_irq_entry(uioinst->id, irq);
+	atomic64_inc(&uioinst->irqcount);
+	if (!vdw_uio_pending(uioinst, &status)) {
+		atomic64_inc(&uioinst->irqnotours);
+	} else {
+		ret = vdw_uio_handler(irq, &uioinst->info);
+	}
+	if (ret == IRQ_HANDLED) {
+		nregs = vdw_uio_capture(uioinst, status, regs, &cause);
+		if (uioinst->snap.size && !uioinst->snap.periodus) {
+			vdw_snapshot_take(uioinst);
+		}
+		/* keep level triggered lines quiet until userspace has
+		 * serviced the device and writes 1 to /dev/uioX
+		 */
+		if (uioinst->automask && !test_and_set_bit(0, &uioinst->irqmasked)
+				&& uioinst->irqrequested) {
+			vdw_irq_disable_lines(uioinst, true);
+		}
+		line = vdw_irq_line(uioinst, irq);
+		vdw_uio_event(uioinst, regs, nregs, cause, line);
+	}
+	trace_vdw_irq_exit(uioinst->id, irq, ret == IRQ_HANDLED,
+			start ? ktime_get_ns() - start : 0);
+	return ret;
+}
+
+/* software triggered event, irq_work context: hardirq, or the irq_work
+ * thread on PREEMPT_RT where uio_event_notify() takes sleeping locks
+ */
+static void vdw_trigger_work(struct irq_work *work) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(work, vdw_uio_dev_priv, trigger);
+	++uioinst->triggers;
+	vdw_uio_event(uioinst, NULL, 0, 0, 0);
+}
+
+static enum hrtimer_restart vdw_gen_timer(struct hrtimer *timer);
+
+static void vdw_trigger_init(vdw_uio_dev_priv_ptr uioinst) {
+	raw_spin_lock_init(&uioinst->triggerlock);
+	init_irq_work(&uioinst->trigger, vdw_trigger_work);
+	vdw_timer_setup(&uioinst->gen.timer, vdw_gen_timer, HRTIMER_MODE_REL);
+	raw_spin_lock_init(&uioinst->snap.lock);
+	vdw_timer_setup(&uioinst->snap.timer, vdw_snap_timer, HRTIMER_MODE_REL_SOFT);
+}
+
+/* stop accepting triggers and wait for the last one to finish, the
+ * generator and the snapshot timer are stopped as well
+ */
+static void vdw_trigger_stop(vdw_uio_dev_priv_ptr uioinst) {
+	unsigned long flags;
+	raw_spin_lock_irqsave(&uioinst->triggerlock, flags);
+	uioinst->triggerlive = false;
+	raw_spin_unlock_irqrestore(&uioinst->triggerlock, flags);
+	irq_work_sync(&uioinst->trigger);
+	hrtimer_cancel(&uioinst->gen.timer);
+	hrtimer_cancel(&uioinst->snap.timer);
+}
+
+static u64 vdw_gen_period(u32 rate, u32 burst) {
+	return max_t(u64, div_u64((u64) max(burst, 1U) * NSEC_PER_SEC, rate),
+			VDW_GEN_MIN_PERIOD_NS);
+}
+
+/* synthetic interrupt, hardirq context like a device interrupt, softirq
+ * on PREEMPT_RT where the notify path takes sleeping locks
+ */
+static enum hrtimer_restart vdw_gen_timer(struct hrtimer *timer) {
+	vdw_uio_gen *gen = container_of(timer, vdw_uio_gen, timer);
+	vdw_uio_dev_priv_ptr uioinst = container_of(gen, vdw_uio_dev_priv, gen);
+	u32 rate = READ_ONCE(gen->rate);
+	u32 burst = max(READ_ONCE(gen->burst), 1U);
+	u64 overruns;
+	u32 iter;
+
+	if (!rate) {
+		return HRTIMER_NORESTART;
+	}
+	for (iter = 0; iter < burst; iter++) {
+		++gen->seq;
+		if (test_bit(0, &uioinst->irqmasked)) {
+			++gen->dropped;
+			continue;
+		}
+		if (gen->seqwrite) {
+			WRITE_ONCE(*(u64*) ((u8*) uioinst->memalloc + VDW_GEN_SEQ_OFFSET),
+					gen->seq);
+		}
+		vdw_uio_irq(uioinst->irq, uioinst);
+	}
+	overruns = hrtimer_forward_now(timer, ns_to_ktime(vdw_gen_period(rate, burst)));
+	if (overruns > 1) {
+		gen->overruns += overruns - 1;
+	}
+	return HRTIMER_RESTART;
+}
+
+static void vdw_gen_start_local(void *arg) {
+	vdw_uio_dev_priv_ptr uioinst = arg;
+	unsigned long flags;
+	raw_spin_lock_irqsave(&uioinst->triggerlock, flags);
+	if (uioinst->triggerlive && uioinst->gen.rate
+			&& !hrtimer_active(&uioinst->gen.timer)) {
+		hrtimer_start(&uioinst->gen.timer,
+				ns_to_ktime(vdw_gen_period(uioinst->gen.rate, uioinst->gen.burst)),
+				HRTIMER_MODE_REL_PINNED);
+	}
+	raw_spin_unlock_irqrestore(&uioinst->triggerlock, flags);
+}
+
+/* (re)start the generator after rate went from 0 to non-zero, pinned to
+ * the instance cpu like the interrupt of a real device would be
+ */
+static void vdw_gen_start(vdw_uio_dev_priv_ptr uioinst) {
+	int cpu = READ_ONCE(uioinst->cpu);
+	if (cpu < 0 || smp_call_function_single(cpu, vdw_gen_start_local,
+			uioinst, 1)) {
+		vdw_gen_start_local(uioinst);
+	}
+}
+
+/* write() on /dev/uioX: 1 unmasks, 0 masks the interrupt lines
+ * every instance holds at most one disable_irq() depth level per line,
+ * so a shared line is enabled again once all sharers unmasked
+ */
+static int vdw_uio_irqcontrol(struct uio_info *info, s32 irq_on) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(info, vdw_uio_dev_priv, info);
+	bool line = uioinst->irqrequested; // synthetic instances only flip the bit
+
+	if (!line && uioinst->irq != VDW_IRQ_SYNTHETIC) {
+		return -EIO;
+	}
+	if (irq_on) {
+		if (test_and_clear_bit(0, &uioinst->irqmasked)) {
+			++uioinst->irqunmasks;
+			if (line) {
+				vdw_irq_enable_lines(uioinst);
+			}
+		}
+	} else if (!test_and_set_bit(0, &uioinst->irqmasked) && line) {
+		vdw_irq_disable_lines(uioinst, false);
+	}
+	trace_vdw_irqcontrol(uioinst->id, irq_on,
+			test_bit(0, &uioinst->irqmasked));
+	return 0;
+}
+
+/*! id: registry id of the instance, for the /dev/uio_vdw ioctls */
+static ssize_t id_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	return sprintf(buf, "%u\n", uioinst->id);
+}
+static DEVICE_ATTR_RO(id);
+
+/* point the interrupts at the instance cpu, or at its node, without
+ * either the irq stays where the system put it; the hint is what
+ * irqbalance honours, clear it (set false) before free_irq()
+ */
+static void vdw_irq_affinity(vdw_uio_dev_priv_ptr uioinst, bool set) {
+	const struct cpumask *mask = 0;
+	int cpu = READ_ONCE(uioinst->cpu);
+	int line;
+
+	if (!uioinst->irqrequested) {
+		return;
+	}
+	if (set && cpu >= 0) {
+		mask = cpumask_of(cpu);
+	} else if (set && uioinst->node != NUMA_NO_NODE) {
+		mask = cpumask_of_node(uioinst->node);
+	}
+	for (line = 0; line < uioinst->nirqs; line++) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+		if (mask) {
+			irq_set_affinity_and_hint(uioinst->irqs[line], mask);
+		} else {
+			irq_update_affinity_hint(uioinst->irqs[line], NULL);
+		}
+#else
+		irq_set_affinity_hint(uioinst->irqs[line], mask);
+#endif
+	}
+}
+
+/*! node: NUMA node of the instance, -1 for none */
+static ssize_t node_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	return sprintf(buf, "%d\n", uioinst->node);
+}
+static DEVICE_ATTR_RO(node);
+
+/*! memnode: node the region pages actually came from, -1 for device
+ * memory, differs from node when that node has no free memory, the
+ * allocator then falls back to another one
+ */
+static ssize_t memnode_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	struct page *page = vdw_mem_page(uioinst);
+	return sprintf(buf, "%d\n", page ? page_to_nid(page) : -1);
+}
+static DEVICE_ATTR_RO(memnode);
+
+/*! local_cpus: cpus of the instance node, where a consumer pins itself */
+static ssize_t local_cpus_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	const struct cpumask *mask = (uioinst->node == NUMA_NO_NODE) ?
+			cpu_online_mask : cpumask_of_node(uioinst->node);
+	return sprintf(buf, "%*pbl\n", cpumask_pr_args(mask));
+}
+static DEVICE_ATTR_RO(local_cpus);
+
+static ssize_t cpu_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	return sprintf(buf, "%d\n", READ_ONCE(uioinst->cpu));
+}
+
+/*! cpu: interrupt affinity, trigger and generator cpu, -1 for any
+ * the memory stays where it was allocated
+ */
+static ssize_t cpu_store(struct device *dev, struct device_attribute *attr,
+		const char *buf, size_t count) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	int cpu;
+	int ret = kstrtoint(buf, 0, &cpu);
+
+	if (ret) {
+		return ret;
+	}
+	if (cpu < -1 || (cpu >= 0 && (cpu >= nr_cpu_ids || !cpu_online(cpu)))) {
+		return -EINVAL;
+	}
+	/* the affinity calls take the descriptor lock and may allocate, so
+	 * module.lock keeps the lines from being freed meanwhile; trylock,
+	 * removal holds it while it waits for this store to return
+	 */
+	if (!mutex_trylock(&module.lock)) {
+		return restart_syscall();
+	}
+	WRITE_ONCE(uioinst->cpu, cpu);
+	if (READ_ONCE(uioinst->triggerlive)) {
+		vdw_irq_affinity(uioinst, true);
+	}
+	mutex_unlock(&module.lock);
+	// move a running generator over
+	if (uioinst->irq == VDW_IRQ_SYNTHETIC && hrtimer_cancel(&uioinst->gen.timer)) {
+		vdw_gen_start(uioinst);
+	}
+	return count;
+}
+static DEVICE_ATTR_RW(cpu);
+
+static ssize_t irq_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	return sprintf(buf, "%d\n", uioinst->irq);
+}
+static DEVICE_ATTR_RO(irq);
+
+static ssize_t irqstats_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	return sprintf(buf, "irqs %llu unmasks %llu automask %d masked %d triggers %llu acks %llu notours %llu eventfds %llu\n",
+			(u64) atomic64_read(&uioinst->irqcount), uioinst->irqunmasks,
+			uioinst->automask, test_bit(0, &uioinst->irqmasked),
+			uioinst->triggers, (u64) atomic64_read(&uioinst->acks),
+			(u64) atomic64_read(&uioinst->irqnotours),
+			(u64) atomic64_read(&uioinst->eventfdsignals));
+}
+static DEVICE_ATTR_RO(irqstats);
+
+/* capture offsets as "<off>+<off>...", hex, the format of "capture=" */
+static size_t vdw_capture_print(char *buffer, size_t size,
+		const vdw_uio_regs *regs) {
+	size_t len = 0;
+	u32 iter;
+	for (iter = 0; iter < regs->ncapture; iter++) {
+		len += scnprintf(buffer + len, size - len, "%s%x", iter ? "+" : "",
+				regs->capture[iter]);
+	}
+	return len;
+}
+
+/* "<n>+<n>...", the format of "irqs=" */
+static size_t vdw_irqs_print(char *buffer, size_t size, const int *irqs,
+		u32 nirqs) {
+	size_t len = 0;
+	u32 iter;
+	for (iter = 0; iter < nirqs; iter++) {
+		len += scnprintf(buffer + len, size - len, "%s%d", iter ? "+" : "",
+				irqs[iter]);
+	}
+	return len;
+}
+
+/* "<addr>/<size>+...", hex, the format of "maps=" */
+static size_t vdw_windows_print(char *buffer, size_t size,
+		const vdw_uio_window *windows, u32 nwindows) {
+	size_t len = 0;
+	u32 iter;
+	for (iter = 0; iter < nwindows; iter++) {
+		len += scnprintf(buffer + len, size - len, "%s%lx/%x", iter ? "+" : "",
+				(unsigned long) windows[iter].start, windows[iter].size);
+	}
+	return len;
+}
+
+/*! lines: "<irq> <count>" per interrupt line, events claimed on it, the
+ * first line also counts software events; line n is "line" n in the
+ * event ring and bit n of the VDW_IOC_EVENTFD lines
+ */
+static ssize_t lines_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	size_t len = 0;
+	int line;
+
+	if (!uioinst->nirqs) {
+		return sprintf(buf, "%d %llu\n", uioinst->irq,
+				(u64) atomic64_read(&uioinst->irqcounts[0]));
+	}
+	for (line = 0; line < uioinst->nirqs; line++) {
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%d %llu\n",
+				uioinst->irqs[line],
+				(u64) atomic64_read(&uioinst->irqcounts[line]));
+	}
+	return len;
+}
+static DEVICE_ATTR_RO(lines);
+
+/*! capture: registers snapshot into each event, empty for none */
+static ssize_t capture_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	size_t len = vdw_capture_print(buf, PAGE_SIZE - 1, &uioinst->regs);
+	buf[len++] = '\n';
+	return len;
+}
+static DEVICE_ATTR_RO(capture);
+
+/*! ack: "<off>/<mask>" written by the top half, mask 0 for none */
+static ssize_t ack_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	return sprintf(buf, "%x/%x\n", uioinst->regs.ackoffset,
+			uioinst->regs.ackmask);
+}
+static DEVICE_ATTR_RO(ack);
+
+/*! pending: "<off>/<mask>" checked before an interrupt is claimed, mask
+ * 0 for none
+ */
+static ssize_t pending_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	return sprintf(buf, "%x/%x\n", uioinst->regs.pendingoffset,
+			uioinst->regs.pendingmask);
+}
+static DEVICE_ATTR_RO(pending);
+
+/*! cause: "<off>/<mask>" read for the eventfd filters, mask 0 for none */
+static ssize_t cause_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	return sprintf(buf, "%x/%x\n", uioinst->regs.causeoffset,
+			uioinst->regs.causemask);
+}
+static DEVICE_ATTR_RO(cause);
+
+/*! snapshot: "<off>/<len> <period us> <copies>", len 0 without a
+ * snapshot page, period 0 when it follows the interrupts
+ */
+static ssize_t snapshot_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	return sprintf(buf, "%x/%x %u %llu\n", uioinst->snap.offset,
+			uioinst->snap.size, uioinst->snap.periodus,
+			uioinst->snap.page ? READ_ONCE(uioinst->snap.page->count) : 0);
+}
+static DEVICE_ATTR_RO(snapshot);
+
+/*! trigger: any write raises one event from irq_work context through the
+ * same path as a device interrupt, the event ring holds its timestamp
+ * -EBUSY while the previous trigger has not run yet, -EIO for instances
+ * without an interrupt (irq 0) since nobody can wait for it
+ * the work runs on the instance cpu when one is set
+ */
+static ssize_t trigger_store(struct device *dev, struct device_attribute *attr,
+		const char *buf, size_t count) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	int cpu = READ_ONCE(uioinst->cpu);
+	unsigned long flags;
+	int ret = count;
+
+	if (uioinst->info.irq == UIO_IRQ_NONE) {
+		return -EIO;
+	}
+	raw_spin_lock_irqsave(&uioinst->triggerlock, flags);
+	if (!uioinst->triggerlive) {
+		ret = -ENODEV;
+	} else if (!(cpu >= 0 && cpu_online(cpu) ?
+			irq_work_queue_on(&uioinst->trigger, cpu) :
+			irq_work_queue(&uioinst->trigger))) {
+		ret = -EBUSY;
+	}
+	raw_spin_unlock_irqrestore(&uioinst->triggerlock, flags);
+	return ret;
+}
+static DEVICE_ATTR_WO(trigger);
+
+/* moderation attributes, /sys/class/uio/uioX/device/<name> */
+#define VDW_MODER_ATTR(_name, _field, _min, _max) \
+static ssize_t _name##_show(struct device *dev, \
+		struct device_attribute *attr, char *buf) { \
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev); \
+	return sprintf(buf, "%u\n", uioinst->moder._field); \
+} \
+static ssize_t _name##_store(struct device *dev, \
+		struct device_attribute *attr, const char *buf, size_t count) { \
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev); \
+	u32 value; \
+	int ret = kstrtou32(buf, 0, &value); \
+	if (ret) { \
+		return ret; \
+	} \
+	if (value < (_min) || value > (_max)) { \
+		return -ERANGE; \
+	} \
+	vdw_moder_set(uioinst, &uioinst->moder._field, value); \
+	return count; \
+} \
+static DEVICE_ATTR_RW(_name)
+
+/*! coalesce_events: notify userspace once this many events are pending,
+ * at most 65536
+ */
+VDW_MODER_ATTR(coalesce_events, maxevents, 0, VDW_MODER_MAX_EVENTS);
+/*! coalesce_usecs: notify at the latest this long after the first event,
+ * 0 (no deadline) up to one second
+ */
+VDW_MODER_ATTR(coalesce_usecs, maxdelayus, 0, USEC_PER_SEC);
+/*! poll_highrate: events/s above which the hrtimer poll mode is used */
+VDW_MODER_ATTR(poll_highrate, highrate, 0, U32_MAX);
+/*! poll_lowrate: events/s below which irq mode is restored */
+VDW_MODER_ATTR(poll_lowrate, lowrate, 0, U32_MAX);
+/*! poll_usecs: notification period in poll mode, 10 us up to one second */
+VDW_MODER_ATTR(poll_usecs, pollus, VDW_MODER_MIN_POLL_US, USEC_PER_SEC);
+
+static ssize_t moderation_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	vdw_uio_moder *moder = &uioinst->moder;
+	return sprintf(buf, "events %llu notifies %llu pollswitches %llu mode %s\n",
+			moder->events, moder->notifies, moder->pollswitches,
+			moder->pollmode ? "poll" : "irq");
+}
+static DEVICE_ATTR_RO(moderation);
+
+/* generator attributes, only present on VDW_IRQ_SYNTHETIC instances */
+static ssize_t gen_rate_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	return sprintf(buf, "%u\n", READ_ONCE(uioinst->gen.rate));
+}
+
+/*! gen_rate: events/s, 0 stops the generator, non-zero (re)starts it */
+static ssize_t gen_rate_store(struct device *dev, struct device_attribute *attr,
+		const char *buf, size_t count) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	u32 value;
+	int ret = kstrtou32(buf, 0, &value);
+	if (ret) {
+		return ret;
+	}
+	WRITE_ONCE(uioinst->gen.rate, value);
+	vdw_gen_start(uioinst);
+	return count;
+}
+static DEVICE_ATTR_RW(gen_rate);
+
+static ssize_t gen_burst_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	return sprintf(buf, "%u\n", READ_ONCE(uioinst->gen.burst));
+}
+
+/*! gen_burst: events raised back to back per timer expiry */
+static ssize_t gen_burst_store(struct device *dev, struct device_attribute *attr,
+		const char *buf, size_t count) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	u32 value;
+	int ret = kstrtou32(buf, 0, &value);
+	if (ret) {
+		return ret;
+	}
+	WRITE_ONCE(uioinst->gen.burst, value);
+	return count;
+}
+static DEVICE_ATTR_RW(gen_burst);
+
+static ssize_t genstats_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(dev, vdw_uio_dev_priv, dev);
+	return sprintf(buf, "seq %llu dropped %llu overruns %llu seqwrite %d\n",
+			uioinst->gen.seq, uioinst->gen.dropped, uioinst->gen.overruns,
+			uioinst->gen.seqwrite);
+}
+static DEVICE_ATTR_RO(genstats);
+
+static struct attribute *vdw_uio_gen_attrs[] = {
+	&dev_attr_gen_rate.attr,
+	&dev_attr_gen_burst.attr,
+	&dev_attr_genstats.attr,
+	NULL,
+};
+
+static umode_t vdw_uio_gen_visible(struct kobject *kobj,
+		struct attribute *attr, int index) {
+	vdw_uio_dev_priv_ptr uioinst = container_of(kobj_to_dev(kobj),
+			vdw_uio_dev_priv, dev);
+	return uioinst->irq == VDW_IRQ_SYNTHETIC ? attr->mode : 0;
+}
+
+static struct attribute *vdw_uio_dev_attrs[] = {
+	&dev_attr_sync.attr,
+	&dev_attr_mapmode.attr,
+	&dev_attr_coalesce_events.attr,
+	&dev_attr_coalesce_usecs.attr,
+	&dev_attr_poll_highrate.attr,
+	&dev_attr_poll_lowrate.attr,
+	&dev_attr_poll_usecs.attr,
+	&dev_attr_moderation.attr,
+	&dev_attr_id.attr,
+	&dev_attr_node.attr,
+	&dev_attr_memnode.attr,
+	&dev_attr_local_cpus.attr,
+	&dev_attr_cpu.attr,
+	&dev_attr_irq.attr,
+	&dev_attr_irqstats.attr,
+	&dev_attr_trigger.attr,
+	&dev_attr_capture.attr,
+	&dev_attr_ack.attr,
+	&dev_attr_pending.attr,
+	&dev_attr_cause.attr,
+	&dev_attr_snapshot.attr,
+	&dev_attr_lines.attr,
+	NULL,
+};
+
+static const struct attribute_group vdw_uio_dev_group = {
+	.attrs = vdw_uio_dev_attrs,
+};
+
+static const struct attribute_group vdw_uio_gen_group = {
+	.attrs = vdw_uio_gen_attrs,
+	.is_visible = vdw_uio_gen_visible,
+};
+
+static const struct attribute_group *vdw_uio_dev_groups[] = {
+	&vdw_uio_dev_group,
+	&vdw_uio_gen_group,
+	NULL,
+};
+
+/* drop the eventfds, every event source is stopped so nobody walks them */
+static void vdw_eventfd_release(vdw_uio_dev_priv_ptr uioinst) {
+	vdw_uio_efds *efds = rcu_dereference_protected(uioinst->efds, true);
+	u32 iter;
+
+	if (!efds) {
+		return;
+	}
+	RCU_INIT_POINTER(uioinst->efds, NULL);
+	for (iter = 0; iter < efds->count; iter++) {
+		eventfd_ctx_put(efds->entry[iter].ctx);
+	}
+	kfree(efds);
+}
+
+/* release the requested lines, dropping the disable depth level the
+ * instance holds so sharers of a line keep working
+ */
+static void vdw_irq_free(vdw_uio_dev_priv_ptr uioinst) {
+	if (!uioinst->irqrequested) {
+		return;
+	}
+	if (test_and_clear_bit(0, &uioinst->irqmasked)) {
+		vdw_irq_enable_lines(uioinst);
+	}
+	vdw_irq_affinity(uioinst, false);
+	while (uioinst->nirqs > 0) {
+		free_irq(uioinst->irqs[--uioinst->nirqs], uioinst);
+	}
+	uioinst->irqrequested = false;
+}
+
+/* tear down a registered instance, the caller unlinks it */
+static void simpledriver_instance_destroy(vdw_uio_dev_priv_ptr uioinst) {
+	u64 start = trace_vdw_instance_remove_enabled() ? ktime_get_ns() : 0;
+	u32 id = uioinst->id;
+	int irq = uioinst->irq;
+
+	pr_debug("UnRegister UIO handler for IRQ=%d name=%s\n",
+			uioinst->irq, uioinst->info.name);
+	// ioctls that looked it up before it left the registry back off
+	mutex_lock(&uioinst->ctllock);
+	uioinst->ctllive = false;
+	mutex_unlock(&uioinst->ctllock);
+	vdw_trigger_stop(uioinst);
+	vdw_irq_free(uioinst);
+	if (uioinst->regbase) {
+		iounmap(uioinst->regbase);
+	}
+	hrtimer_cancel(&uioinst->moder.timer);
+	uio_unregister_device(&uioinst->info);
+	simpledriver_memput(uioinst); // exported dma-bufs may keep it
+	simpledriver_ringfree(uioinst);
+	simpledriver_snapfree(uioinst);
+	vdw_eventfd_release(uioinst);
+	if (uioinst->ownerid) {
+		WRITE_ONCE(*uioinst->ownerid, 0); // e.g. devrm of a configfs instance
+	}
+	device_unregister(&uioinst->dev); // last reference frees uioinst
+	trace_vdw_instance_remove(id, irq, start ? ktime_get_ns() - start : 0);
+}
+
+/* called with module.lock held */
+static int simpledriver_instance_remove(int instance) {
+	int ret = -ENODEV;
+	vdw_uio_dev_priv_ptr uioinst;
+	pr_debug("simpledriver_instance_remove begin, %d instances, remove %d\n",
+			module.instancecount, instance);
+	uioinst = (instance > 0) ? xa_erase(&module.instances, instance) : 0;
+	if (!uioinst) {
+		printk( KERN_ERR "simpledriver_instance_remove, no instance %d!\n", instance);
+	} else {
+		simpledriver_instance_destroy(uioinst);
+		--module.instancecount;
+		ret = 0;
+	}
+	pr_debug("simpledriver_instance_remove, %d instances left\n", module.instancecount);
+	return ret;
+}
+
+/* tear down the instances queued on batch (->batch), they left the
+ * registry and stopped their event sources already; the count is
+ * updated once, called with module.lock held
+ * @return instances destroyed
+ */
+static u32 simpledriver_instance_destroy_batch(struct list_head *batch) {
+	vdw_uio_dev_priv_ptr uioinst, next;
+	u32 removed = 0;
+	list_for_each_entry_safe(uioinst, next, batch, batch) {
+		list_del(&uioinst->batch);
+		simpledriver_instance_destroy(uioinst);
+		++removed;
+	}
+	module.instancecount -= removed;
+	return removed;
+}
+
+/* remove the instances of an id[-id][,id[-id]...] list, ids in a range
+ * that do not exist are skipped; every instance leaves the registry and
+ * stops its event sources before the first one is torn down, the count
+ * is updated and logged once
+ * called with module.lock held
+ */
+static int simpledriver_instance_remove_batch(const char *ids) {
+	LIST_HEAD(batch);
+	vdw_uio_dev_priv_ptr uioinst;
+	char *idscopy, *reststring, *rangestring, *laststring;
+	unsigned long first, last, index;
+	u32 removed = 0;
+	int error = 0;
+
+	idscopy = kstrdup(ids, GFP_KERNEL);
+	if (!idscopy) return -ENOMEM;
+
+	reststring = strim(idscopy);
+	while (!error && (rangestring = strsep(&reststring, ","))) {
+		if (!*rangestring) {
+			continue; // trailing comma
+		}
+		laststring = rangestring;
+		rangestring = strsep(&laststring, "-");
+		error = kstrtoul(rangestring, 10, &first);
+		last = first;
+		if (!error && laststring) error = kstrtoul(laststring, 10, &last);
+		if (!error && (!first || last < first)) error = -EINVAL;
+		if (error) {
+			printk(KERN_WARNING "devrm: bad id list %s\n", ids);
+			break; // the instances collected so far still go
+		}
+		xa_for_each_range(&module.instances, index, uioinst, first, last) {
+			xa_erase(&module.instances, index);
+			vdw_trigger_stop(uioinst);
+			list_add_tail(&uioinst->batch, &batch);
+		}
+	}
+	removed = simpledriver_instance_destroy_batch(&batch);
+	pr_debug("simpledriver_instance_remove_batch, %u removed, %d instances left\n",
+			removed, module.instancecount);
+	kfree(idscopy);
+	if (!error && !removed) {
+		printk(KERN_WARNING "devrm: no instance in %s\n", ids);
+		error = -ENODEV;
+	}
+	return error;
+}
+
+/* a capture or ack register must be an aligned word inside the region */
+static int vdw_reg_check(u32 offset, u32 regsize) {
+	if (offset % sizeof(u32) || offset >= regsize
+			|| regsize - offset < sizeof(u32)) {
+		printk(KERN_WARNING "Register offset %x outside region or unaligned\n",
+				offset);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* create one instance, its id is returned in *id when id is not 0
+ * called with module.lock held
+ */
+static int simpledriver_instance_init(const vdw_uio_params *params, u32 *id) {
+	int error = -1;
+	int irq = params->irq;
+	uintptr_t regstart = params->regstart;
+	uint32_t regsize = params->regsize;
+	vdw_uio_mapmode mapmode = params->mapmode;
+	int node = params->node;
+	bool devregistered = false;
+	bool idallocated = false;
+	u64 start = trace_vdw_instance_add_enabled() ? ktime_get_ns() : 0;
+	u32 newid = 0;
+	u32 iter;
+	struct uio_mem *uiomem = 0;
+	vdw_uio_dev_priv_ptr uioinst = 0;
+
+	pr_debug("instance_init irq=%d start=%lx size=%u mode=%s backend=%s\n",
+			irq, regstart, regsize, mapmodenames[mapmode],
+			backendnames[params->backend]);
+
+	if (regstart % PAGE_SIZE) {
+		printk(KERN_WARNING "Reg space start must be page-aligned\n");
+		error = -EFAULT;
+		goto exit_func;
+	}
+
+	if (regstart && mapmode == VDW_MAP_CACHED) {
+		/* no "sync" for device memory, only sane for windows that
+		 * tolerate speculative reads and are flushed by the user
+		 */
+		printk(KERN_WARNING "Mode %s on device memory at %lx, no cache maintenance\n",
+				mapmodenames[mapmode], regstart);
+	}
+
+	if (regstart && params->backend != VDW_ALLOC_KMALLOC) {
+		printk(KERN_WARNING "Backend %s only allowed for kernel allocated memory\n",
+				backendnames[params->backend]);
+		error = -EINVAL;
+		goto exit_func;
+	}
+
+	if (irq != VDW_IRQ_SYNTHETIC && (params->genrate || params->genburst
+			|| params->genseqwrite)) {
+		printk(KERN_WARNING "Generator options only allowed for irq %d\n",
+				VDW_IRQ_SYNTHETIC);
+		error = -EINVAL;
+		goto exit_func;
+	}
+
+	if ((regstart || regsize < VDW_GEN_SEQ_OFFSET + sizeof(u64))
+			&& params->genseqwrite) {
+		printk(KERN_WARNING "seqwrite only allowed for kernel allocated memory\n");
+		error = -EINVAL;
+		goto exit_func;
+	}
+
+	for (iter = 0; iter < params->regs.ncapture; iter++) {
+		if (vdw_reg_check(params->regs.capture[iter], regsize)) {
+			error = -EINVAL;
+			goto exit_func;
+		}
+	}
+	if (params->regs.ackmask && vdw_reg_check(params->regs.ackoffset, regsize)) {
+		error = -EINVAL;
+		goto exit_func;
+	}
+	if (params->regs.pendingmask
+			&& vdw_reg_check(params->regs.pendingoffset, regsize)) {
+		error = -EINVAL;
+		goto exit_func;
+	}
+	if (params->regs.causemask
+			&& vdw_reg_check(params->regs.causeoffset, regsize)) {
+		error = -EINVAL;
+		goto exit_func;
+	}
+	if (params->snapsize && (params->snapsize % sizeof(u32)
+			|| vdw_reg_check(params->snapoffset, regsize)
+			|| params->snapsize > regsize - params->snapoffset)) {
+		printk(KERN_WARNING "Snapshot %x/%x outside region or unaligned\n",
+				params->snapoffset, params->snapsize);
+		error = -EINVAL;
+		goto exit_func;
+	}
+	if (params->nirqs && irq <= 0) {
+		printk(KERN_WARNING "irqs only allowed for a driver owned interrupt\n");
+		error = -EINVAL;
+		goto exit_func;
+	}
+	for (iter = 0; iter < params->nirqs; iter++) {
+		u32 other;
+		bool twice = params->irqs[iter] == irq;
+		for (other = 0; other < iter; other++) {
+			twice |= params->irqs[other] == params->irqs[iter];
+		}
+		if (params->irqs[iter] <= 0 || twice) {
+			printk(KERN_WARNING "Interrupt %d invalid or given twice\n",
+					params->irqs[iter]);
+			error = -EINVAL;
+			goto exit_func;
+		}
+	}
+	if (params->nwindows > MAX_UIO_MAPS - vdw_uio_windowmap(params->snapsize)) {
+		printk(KERN_WARNING "Only %u maps fit besides the driver maps\n",
+				MAX_UIO_MAPS - vdw_uio_windowmap(params->snapsize));
+		error = -E2BIG;
+		goto exit_func;
+	}
+	for (iter = 0; iter < params->nwindows; iter++) {
+		if (!params->windows[iter].start || !params->windows[iter].size
+				|| params->windows[iter].start % PAGE_SIZE) {
+			printk(KERN_WARNING "Map %lx/%x must be page aligned device memory\n",
+					(unsigned long) params->windows[iter].start,
+					params->windows[iter].size);
+			error = -EINVAL;
+			goto exit_func;
+		}
+	}
+	if (params->snapus && (!params->snapsize
+			|| params->snapus < VDW_SNAP_MIN_PERIOD_US)) {
+		printk(KERN_WARNING "snapus needs a snapshot and at least %u us\n",
+				VDW_SNAP_MIN_PERIOD_US);
+		error = -EINVAL;
+		goto exit_func;
+	}
+	if (!params->snapus && params->snapsize > VDW_SNAP_IRQ_MAX) {
+		printk(KERN_WARNING "Snapshot on interrupt limited to %u bytes, use snapus\n",
+				VDW_SNAP_IRQ_MAX);
+		error = -EINVAL;
+		goto exit_func;
+	}
+
+	if (params->cpu >= 0 && (params->cpu >= nr_cpu_ids
+			|| !cpu_online(params->cpu))) {
+		printk(KERN_WARNING "cpu %d is not online\n", params->cpu);
+		error = -EINVAL;
+		goto exit_func;
+	}
+	if (node == NUMA_NO_NODE && params->cpu >= 0) {
+		node = cpu_to_node(params->cpu);
+	}
+	if (node != NUMA_NO_NODE && (node < 0 || node >= nr_node_ids
+			|| !node_online(node))) {
+		printk(KERN_WARNING "NUMA node %d is not online\n", node);
+		error = -EINVAL;
+		goto exit_func;
+	}
+
+	uioinst = kzalloc_node(sizeof(vdw_uio_dev_priv), GFP_KERNEL, node);
+	if (!uioinst) {
+		printk(KERN_WARNING "Failing to allocate module struct\n");
+		error = -ENOMEM;
+		goto exit_func;
+	}
+
+	// reserve the id, the entry is published once the instance works
+	error = xa_alloc_cyclic(&module.instances, &uioinst->id, NULL,
+			xa_limit_31b, &module.nextid, GFP_KERNEL);
+	if (error < 0) {
+		printk(KERN_WARNING "Failing to allocate instance id\n");
+		kfree(uioinst);
+		uioinst = 0;
+		goto exit_func;
+	}
+	error = -1;
+	idallocated = true;
+	newid = uioinst->id;
+
+	dev_set_name(&uioinst->dev, "%s_%u", DRV_DEVICE_NAME, uioinst->id);
+	uioinst->dev.release = simpledriver_release;
+	uioinst->dev.groups = vdw_uio_dev_groups;
+	uioinst->dev.dma_mask = &uioinst->dev.coherent_dma_mask;
+	uioinst->mapmode = mapmode;
+	uioinst->backend = params->backend;
+	uioinst->automask = params->automask;
+	uioinst->irq = irq; // before device_register, see vdw_uio_gen_visible
+	uioinst->node = node;
+	uioinst->cpu = params->cpu;
+	set_dev_node(&uioinst->dev, node); // dma_alloc_pages() of contig
+	uioinst->gen.rate = params->genrate;
+	uioinst->gen.burst = params->genburst;
+	uioinst->gen.seqwrite = params->genseqwrite;
+	uioinst->regs = params->regs;
+	uioinst->ackindex = -1;
+	uioinst->pendingindex = -1;
+	uioinst->causeindex = -1;
+	for (iter = uioinst->regs.ncapture; iter-- > 0;) { // first match wins
+		if (uioinst->regs.ackmask
+				&& uioinst->regs.capture[iter] == uioinst->regs.ackoffset) {
+			uioinst->ackindex = iter;
+		}
+		if (uioinst->regs.pendingmask
+				&& uioinst->regs.capture[iter] == uioinst->regs.pendingoffset) {
+			uioinst->pendingindex = iter;
+		}
+		if (uioinst->regs.causemask
+				&& uioinst->regs.capture[iter] == uioinst->regs.causeoffset) {
+			uioinst->causeindex = iter;
+		}
+	}
+	vdw_moder_init(&uioinst->moder);
+	vdw_trigger_init(uioinst);
+	mutex_init(&uioinst->ctllock);
+	refcount_set(&uioinst->memrefs, 1);
+
+	if (device_register(&uioinst->dev)) {
+		printk(KERN_WARNING "Failing to register dev device\n");
+		error = -ENODEV;
+		goto exit_func;
+	}
+
+	devregistered = true;
+
+	scnprintf(uioinst->name, VDW_NAMELEN, "%s_%lx", DRV_DEVICE_NAME,
+			(uintptr_t) (regstart ? regstart : uioinst->id));
+	uioinst->info.name = uioinst->name;
+	uioinst->info.version = "1.0.0";
+	/* positive irq numbers are requested by the driver itself so that
+	 * vdw_moder_event() decides when uio_event_notify() is called
+	 */
+	uioinst->info.irq = (irq > 0 || irq == VDW_IRQ_SYNTHETIC) ?
+			UIO_IRQ_CUSTOM : irq;
+	if (irq > 0 || irq == VDW_IRQ_SYNTHETIC) {
+		uioinst->info.irqcontrol = vdw_uio_irqcontrol;
+	}
+	uioinst->info.mmap = vdw_uio_mmap; // mapping mode per region
+
+	// round to page
+	regsize = ((regsize + PAGE_SIZE - 1) / PAGE_SIZE) * PAGE_SIZE;
+
+	uiomem = &uioinst->info.mem[0];
+	// Connect this info to the UIO subsystem
+	uiomem->size = regsize;
+	uiomem->offs = 0;
+	scnprintf(uioinst->mapnames[0], VDW_NAMELEN, "%s_map0", uioinst->info.name);
+	uiomem->name = uioinst->mapnames[0];
+
+	uioinst->regstart = regstart;
+	uioinst->regsize = regsize;
+
+	if (!regstart && params->backend == VDW_ALLOC_CONTIG) {
+		dma_set_mask_and_coherent(&uioinst->dev, vdw_mem_dmamask(uioinst));
+		error = simpledriver_contigalloc(uioinst);
+		if (error) {
+			goto exit_func;
+		}
+		uiomem->addr = page_to_phys(uioinst->mempages);
+		pr_debug("contig %px, pa=%pa, dma=%pad, size=%u bytes, %s\n",
+				uioinst->memalloc, &uiomem->addr, &uioinst->memdma,
+				(unsigned int) regsize, uioinst->memcma ? "cma" : "buddy");
+		uiomem->memtype = UIO_MEM_PHYS;
+	} else if (!regstart && mapmode == VDW_MAP_CACHED) {
+		/* page allocator instead of kzalloc, whole pages that
+		 * vdw_uio_mmap() maps cacheable with remap_pfn_range()
+		 * */
+		uioinst->memalloc = alloc_pages_exact_nid(uioinst->node, regsize,
+				GFP_KERNEL | vdw_mem_zone(uioinst, GFP_DMA) | __GFP_ZERO);
+		if (!uioinst->memalloc) {
+			printk(KERN_WARNING "Failing to allocate mappable memory\n");
+			error = -ENOMEM;
+			goto exit_func;
+		}
+		dma_set_mask_and_coherent(&uioinst->dev, vdw_mem_dmamask(uioinst));
+		uioinst->memdma = dma_map_single(&uioinst->dev, uioinst->memalloc,
+				regsize, DMA_BIDIRECTIONAL);
+		if (dma_mapping_error(&uioinst->dev, uioinst->memdma)) {
+			printk(KERN_WARNING "Failing to map memory for cache sync\n");
+			uioinst->memdma = 0;
+			error = -ENOMEM;
+			goto exit_func;
+		}
+		pr_debug("memalloc %px, pa=%px, dma=%pad, size=%u bytes\n",
+				(void*) uioinst->memalloc, (void*) __pa(uioinst->memalloc),
+				&uioinst->memdma, (unsigned int) regsize);
+		/* cacheable mapping, userspace syncs through the "sync"
+		 * attribute when handing data to/from the device
+		 * */
+		uiomem->addr = (phys_addr_t) (uintptr_t) uioinst->memalloc;
+		uiomem->memtype = UIO_MEM_LOGICAL;
+	} else if (!regstart) {
+		uioinst->memalloc = kzalloc_node(regsize,
+				GFP_KERNEL | vdw_mem_zone(uioinst, GFP_DMA), uioinst->node);
+		pr_debug("memalloc %px, pa=%px, size=%u bytes\n",
+				(void*) uioinst->memalloc, (void*) __pa(uioinst->memalloc),
+				(unsigned int) regsize);
+		if (!uioinst->memalloc) {
+			printk(KERN_WARNING "Failing to allocate mappable memory\n");
+			error = -ENOMEM;
+			goto exit_func;
+		}
+		/* physical address mapping, vdw_uio_mmap()
+		 * applies the mapping mode and calls
+		 * remap_pfn_range()
+		 * */
+		uiomem->addr = (phys_addr_t) __pa(uioinst->memalloc);
+		uiomem->memtype = UIO_MEM_PHYS;
+	} else {
+		pr_debug("regstart %px, pa=%px, size=%u bytes\n",
+				(void*) regstart, (void*) __pa(regstart), (unsigned int) regsize);
+		uiomem->addr = (phys_addr_t)(regstart);
+		uiomem->memtype = UIO_MEM_PHYS;
+	}
+
+	if (uioinst->regs.ncapture || uioinst->regs.ackmask
+			|| uioinst->regs.pendingmask || uioinst->regs.causemask
+			|| params->snapsize) {
+		if (regstart) {
+			uioinst->regbase = ioremap(regstart, regsize);
+		}
+		if (!uioinst->regbase && !uioinst->memalloc) {
+			printk(KERN_WARNING "Failing to map registers for the top half or snapshot\n");
+			error = -ENOMEM;
+			goto exit_func;
+		}
+	}
+
+	error = simpledriver_ringalloc(uioinst);
+	if (error) {
+		goto exit_func;
+	}
+	if (params->snapsize) {
+		error = simpledriver_snapalloc(uioinst, params);
+		if (error) {
+			goto exit_func;
+		}
+	}
+	// windows follow without a gap, then the sentinel
+	for (iter = 0; iter < params->nwindows; iter++) {
+		uiomem = &uioinst->info.mem[vdw_uio_windowmap(params->snapsize) + iter];
+		uiomem->addr = (phys_addr_t) params->windows[iter].start;
+		uiomem->size = PAGE_ALIGN(params->windows[iter].size);
+		uiomem->offs = 0;
+		uiomem->memtype = UIO_MEM_PHYS;
+		uiomem->name = uioinst->mapnames[uiomem - uioinst->info.mem];
+		scnprintf(uioinst->mapnames[uiomem - uioinst->info.mem], VDW_NAMELEN,
+				"%s_win%u", uioinst->info.name, iter + 1);
+		uioinst->windows[iter] = params->windows[iter];
+	}
+	uioinst->nwindows = params->nwindows;
+	iter = vdw_uio_windowmap(params->snapsize) + params->nwindows;
+	if (iter < MAX_UIO_MAPS) {
+		uioinst->info.mem[iter].size = 0;
+	}
+
+	if (uio_register_device(&uioinst->dev, &uioinst->info) < 0) {
+		printk(KERN_WARNING "Failing to register uio device\n");
+		error = -ENODEV;
+		goto exit_func;
+	}
+
+	if (irq > 0) {
+		error = request_irq(irq, vdw_uio_irq, IRQF_SHARED,
+				uioinst->info.name, uioinst);
+		if (error) {
+			printk(KERN_WARNING "Failing to request IRQ=%d (%d)\n", irq, error);
+			uio_unregister_device(&uioinst->info);
+			goto exit_func;
+		}
+		uioinst->irqs[0] = irq;
+		uioinst->nirqs = 1;
+		uioinst->irqrequested = true;
+		for (iter = 0; iter < params->nirqs; iter++) {
+			// known before it can fire, see vdw_irq_line()
+			uioinst->irqs[uioinst->nirqs] = params->irqs[iter];
+			error = request_irq(params->irqs[iter], vdw_uio_irq, IRQF_SHARED,
+					uioinst->info.name, uioinst);
+			if (error) {
+				printk(KERN_WARNING "Failing to request IRQ=%d (%d)\n",
+						params->irqs[iter], error);
+				vdw_irq_free(uioinst);
+				uio_unregister_device(&uioinst->info);
+				goto exit_func;
+			}
+			WRITE_ONCE(uioinst->nirqs, uioinst->nirqs + 1);
+		}
+		vdw_irq_affinity(uioinst, true);
+	}
+	WRITE_ONCE(uioinst->triggerlive, true); // uio is live, allow triggers
+	vdw_gen_start(uioinst);
+	vdw_snap_start(uioinst);
+	pr_debug("Registered %s id=%u IRQ=%d pa=%pa size=%u\n",
+			uioinst->info.name, uioinst->id, irq,
+			&uioinst->info.mem[0].addr, regsize);
+	uioinst->ctllive = true; // not published yet, nobody holds ctllock
+	xa_store(&module.instances, uioinst->id, uioinst, GFP_KERNEL);
+	++module.instancecount;
+	if (id) {
+		*id = uioinst->id;
+	}
+	error = 0;
+
+	exit_func: if (error) {
+		if (idallocated) {
+			xa_erase(&module.instances, uioinst->id);
+		}
+		if (devregistered) {
+			if (uioinst->regbase) {
+				iounmap(uioinst->regbase);
+			}
+			simpledriver_memfree(uioinst);
+			simpledriver_ringfree(uioinst);
+			simpledriver_snapfree(uioinst);
+			device_unregister(&uioinst->dev); // frees uioinst
+		} else if (uioinst) {
+			put_device(&uioinst->dev); // frees uioinst
+		}
+	}
+	trace_vdw_instance_add(newid, irq, regstart, params->regsize,
+			start ? ktime_get_ns() - start : 0, error);
+	return error;
+}
+
+/* "<off>[+<off>...]", hex byte offsets, empty for none */
+static int simpledriver_parsecapture(const char *str, vdw_uio_regs *regs) {
+	char *copy = kstrdup(str, GFP_KERNEL);
+	char *rest, *offstr;
+	u32 capture[VDW_EVENT_REGS];
+	u32 ncapture = 0;
+	int error = 0;
+
+	if (!copy) {
+		return -ENOMEM;
+	}
+	rest = strim(copy);
+	if (!*rest) {
+		rest = NULL;
+	}
+	while (!error && (offstr = strsep(&rest, "+"))) {
+		if (ncapture == VDW_EVENT_REGS) {
+			error = -E2BIG;
+			break;
+		}
+		error = kstrtou32(offstr, 16, &capture[ncapture++]);
+	}
+	if (!error) {
+		memcpy(regs->capture, capture, ncapture * sizeof(*capture));
+		regs->ncapture = ncapture;
+	}
+	kfree(copy);
+	return error;
+}
+
+/* "<irq>[+<irq>...]", decimal, empty for none */
+static int simpledriver_parseirqs(const char *str, vdw_uio_params *params) {
+	char *copy = kstrdup(str, GFP_KERNEL);
+	char *rest, *irqstr;
+	int irqs[VDW_MAXIRQS - 1];
+	u32 nirqs = 0;
+	int error = 0;
+
+	if (!copy) {
+		return -ENOMEM;
+	}
+	rest = strim(copy);
+	if (!*rest) {
+		rest = NULL;
+	}
+	while (!error && (irqstr = strsep(&rest, "+"))) {
+		if (nirqs == ARRAY_SIZE(irqs)) {
+			error = -E2BIG;
+			break;
+		}
+		error = kstrtoint(irqstr, 10, &irqs[nirqs++]);
+	}
+	if (!error) {
+		memcpy(params->irqs, irqs, nirqs * sizeof(*irqs));
+		params->nirqs = nirqs;
+	}
+	kfree(copy);
+	return error;
+}
+
+/* "<addr>/<size>[+<addr>/<size>...]", hex, empty for none */
+static int simpledriver_parsemaps(const char *str, vdw_uio_params *params) {
+	char *copy = kstrdup(str, GFP_KERNEL);
+	char *rest, *mapstr, *sizestr;
+	vdw_uio_window windows[VDW_MAXWINDOWS];
+	unsigned long mapstart = 0;
+	u32 nwindows = 0;
+	int error = 0;
+
+	if (!copy) {
+		return -ENOMEM;
+	}
+	rest = strim(copy);
+	if (!*rest) {
+		rest = NULL;
+	}
+	while (!error && (mapstr = strsep(&rest, "+"))) {
+		if (nwindows == VDW_MAXWINDOWS) {
+			error = -E2BIG;
+			break;
+		}
+		sizestr = mapstr;
+		mapstr = strsep(&sizestr, "/");
+		error = sizestr ? kstrtoul(mapstr, 16, &mapstart) : -EINVAL;
+		if (!error) {
+			error = kstrtou32(sizestr, 16, &windows[nwindows].size);
+		}
+		windows[nwindows++].start = mapstart;
+	}
+	if (!error) {
+		memcpy(params->windows, windows, nwindows * sizeof(*windows));
+		params->nwindows = nwindows;
+	}
+	kfree(copy);
+	return error;
+}
+
+/* "<off>/<mask>", hex, mask 0 disables the register, also "<off>/<len>" */
+static int simpledriver_parsereg(const char *str, u32 *regoffset, u32 *regmask) {
+	char *copy = kstrdup(str, GFP_KERNEL);
+	char *maskstr, *offstr;
+	u32 offset, mask;
+	int error = -EINVAL;
+
+	if (!copy) {
+		return -ENOMEM;
+	}
+	maskstr = strim(copy);
+	offstr = strsep(&maskstr, "/");
+	if (maskstr && !kstrtou32(offstr, 16, &offset)
+			&& !kstrtou32(maskstr, 16, &mask)) {
+		*regoffset = offset;
+		*regmask = mask;
+		error = 0;
+	}
+	kfree(copy);
+	return error;
+}
+
+/* one ":option" of a region, a mapping mode, a backend, a flag, a
+ * generator setting, a placement or a top half register description
+ */
+static int simpledriver_parseoption(const char *optstr,
+		vdw_uio_params *params) {
+	int iter;
+	for (iter = 0; iter < ARRAY_SIZE(mapmodenames); iter++) {
+		if (!strcmp(optstr, mapmodenames[iter])) {
+			params->mapmode = (vdw_uio_mapmode) iter;
+			return 0;
+		}
+	}
+	for (iter = 0; iter < ARRAY_SIZE(backendnames); iter++) {
+		if (!strcmp(optstr, backendnames[iter])) {
+			params->backend = (vdw_uio_backend) iter;
+			return 0;
+		}
+	}
+	if (!strcmp(optstr, "automask")) {
+		params->automask = true;
+		return 0;
+	}
+	if (!strncmp(optstr, "rate=", 5)) {
+		return kstrtou32(optstr + 5, 10, &params->genrate);
+	}
+	if (!strncmp(optstr, "burst=", 6)) {
+		return kstrtou32(optstr + 6, 10, &params->genburst);
+	}
+	if (!strcmp(optstr, "seqwrite")) {
+		params->genseqwrite = true;
+		return 0;
+	}
+	if (!strncmp(optstr, "node=", 5)) {
+		return kstrtoint(optstr + 5, 10, &params->node);
+	}
+	if (!strncmp(optstr, "cpu=", 4)) {
+		return kstrtoint(optstr + 4, 10, &params->cpu);
+	}
+	if (!strncmp(optstr, "capture=", 8)) {
+		return simpledriver_parsecapture(optstr + 8, &params->regs);
+	}
+	if (!strncmp(optstr, "ack=", 4)) {
+		return simpledriver_parsereg(optstr + 4, &params->regs.ackoffset,
+				&params->regs.ackmask);
+	}
+	if (!strncmp(optstr, "pending=", 8)) {
+		return simpledriver_parsereg(optstr + 8, &params->regs.pendingoffset,
+				&params->regs.pendingmask);
+	}
+	if (!strncmp(optstr, "cause=", 6)) {
+		return simpledriver_parsereg(optstr + 6, &params->regs.causeoffset,
+				&params->regs.causemask);
+	}
+	if (!strncmp(optstr, "irqs=", 5)) {
+		return simpledriver_parseirqs(optstr + 5, params);
+	}
+	if (!strncmp(optstr, "maps=", 5)) {
+		return simpledriver_parsemaps(optstr + 5, params);
+	}
+	if (!strncmp(optstr, "snapshot=", 9)) {
+		return simpledriver_parsereg(optstr + 9, &params->snapoffset,
+				&params->snapsize);
+	}
+	if (!strncmp(optstr, "snapus=", 7)) {
+		return kstrtou32(optstr + 7, 10, &params->snapus);
+	}
+	if (!strncmp(optstr, "count=", 6)) {
+		return kstrtou32(optstr + 6, 10, &params->count);
+	}
+	printk(KERN_WARNING "unknown region option %s\n", optstr);
+	return -EINVAL;
+}
+
+/* create the instances of a devadd/devregions list, all of them or,
+ * when an entry fails, none: the ones created so far are removed again
+ * called with module.lock held
+ */
+static int simpledriver_instance_add(const char* params)
+{
+	int error = 0;
+	vdw_uio_params instparams;
+	unsigned long regstartparam;
+	char *paramscopy;
+	char *reststring;
+	char *irqstring, *startstring, *sizestring, *optstring, *optiter;
+	LIST_HEAD(created);
+	vdw_uio_dev_priv_ptr uioinst;
+	u32 count = 0;
+	u32 ncreated = 0;
+	u32 newid;
+	u32 iter;
+
+	pr_debug("vdw-driver simpledriver_instance_add, regions (irq,start,size[:option...][,...]) = %s\n",
+			params?params:"NULL");
+
+	if (!params || !strlen(params)) return -EINVAL;
+
+	paramscopy = kstrdup(params, GFP_KERNEL);
+	if (!paramscopy) return -ENOMEM;
+
+	reststring = strim(paramscopy);
+	do {
+		irqstring = strsep(&reststring, ",");
+		startstring = strsep(&reststring, ",");
+		sizestring = strsep(&reststring, ",");
+		if (!startstring || !sizestring) {
+			error = -EINVAL;
+			break;
+		}
+		optstring = sizestring;
+		sizestring = strsep(&optstring, ":");
+		memset(&instparams, 0, sizeof(instparams));
+		instparams.node = NUMA_NO_NODE;
+		instparams.cpu = -1;
+		pr_debug("irqparam %s, regstartparam %s, regsizeparam %s, options %s\r\n",
+				irqstring, startstring, sizestring, optstring?optstring:"default");
+		error = kstrtoint(irqstring, 10, &instparams.irq);
+		if (!error) error = kstrtoul(startstring, 16, &regstartparam);
+		if (!error) error = kstrtou32(sizestring, 10, &instparams.regsize);
+		while (!error && (optiter = strsep(&optstring, ":"))) {
+			error = simpledriver_parseoption(optiter, &instparams);
+		}
+		if (!error) {
+			instparams.regstart = regstartparam;
+			count = max(instparams.count, 1U);
+			if (count > VDW_MAXCOUNT || (count > 1 && regstartparam)) {
+				printk(KERN_WARNING "count=%u needs regaddress 0 and at most %u\n",
+						count, VDW_MAXCOUNT);
+				error = -EINVAL;
+			}
+		}
+		for (iter = 0; !error && iter < count; iter++) {
+			error = simpledriver_instance_init(&instparams, &newid);
+			if (!error) {
+				uioinst = xa_load(&module.instances, newid);
+				list_add_tail(&uioinst->batch, &created);
+				++ncreated;
+			}
+		}
+		if (error) { // either parsing failed or instance_init
+			break;
+		}
+	} while (reststring && *reststring);
+
+	if (error) {
+		list_for_each_entry(uioinst, &created, batch) {
+			xa_erase(&module.instances, uioinst->id);
+			vdw_trigger_stop(uioinst);
+		}
+		simpledriver_instance_destroy_batch(&created);
+	}
+	pr_debug("simpledriver_instance_add, %u instances %s\n", ncreated,
+			error ? "rolled back" : "created");
+	kfree(paramscopy);
+	return error;
+}
+
+#if IS_ENABLED(CONFIG_CONFIGFS_FS)
+/* configfs instance management, /sys/kernel/config/uio_vdw
+ * mkdir <name> stages an instance, its attributes (irq, base, size,
+ * mode, backend, automask, rate, burst, seqwrite, node, cpu, capture,
+ * ack, pending, cause, irqs, maps, snapshot, snapus) are set one by one
+ * and nothing is created until 1 is written to
+ * /sys/kernel/config/uio_vdw/commit, which creates all staged instances
+ * in one batch, or none of them
+ * rmdir removes the instance, live or staged; an instance removed with
+ * devrm leaves its item staged again (id 0)
+ */
+typedef struct _vdw_cfs_inst {
+	struct config_item item;
+	struct list_head node; // vdw_cfs_insts, module.lock
+	vdw_uio_params params;
+	u32 id; // 0 while staged
+	bool batch; // created by the commit in progress
+} vdw_cfs_inst;
+
+static LIST_HEAD(vdw_cfs_insts);
+
+static inline vdw_cfs_inst *to_vdw_cfs_inst(struct config_item *item) {
+	return container_of(item, vdw_cfs_inst, item);
+}
+
+/* attribute store helper, parameters of live instances are read-only */
+static ssize_t vdw_cfs_store(struct config_item *item, const char *page,
+		size_t count, int (*parse)(const char *, vdw_uio_params *)) {
+	vdw_cfs_inst *inst = to_vdw_cfs_inst(item);
+	int ret;
+	mutex_lock(&module.lock);
+	ret = inst->id ? -EBUSY : parse(page, &inst->params);
+	mutex_unlock(&module.lock);
+	return ret ? ret : count;
+}
+
+static int vdw_cfs_parse_irq(const char *page, vdw_uio_params *params) {
+	return kstrtoint(page, 10, &params->irq);
+}
+
+static int vdw_cfs_parse_base(const char *page, vdw_uio_params *params) {
+	unsigned long base;
+	int ret = kstrtoul(page, 16, &base);
+	if (!ret) {
+		params->regstart = base;
+	}
+	return ret;
+}
+
+static int vdw_cfs_parse_size(const char *page, vdw_uio_params *params) {
+	return kstrtou32(page, 0, &params->regsize);
+}
+
+static int vdw_cfs_parse_mode(const char *page, vdw_uio_params *params) {
+	int ret = sysfs_match_string(mapmodenames, page);
+	if (ret >= 0) {
+		params->mapmode = (vdw_uio_mapmode) ret;
+	}
+	return ret < 0 ? ret : 0;
+}
+
+static int vdw_cfs_parse_backend(const char *page, vdw_uio_params *params) {
+	int ret = sysfs_match_string(backendnames, page);
+	if (ret >= 0) {
+		params->backend = (vdw_uio_backend) ret;
+	}
+	return ret < 0 ? ret : 0;
+}
+
+static int vdw_cfs_parse_automask(const char *page, vdw_uio_params *params) {
+	return kstrtobool(page, &params->automask);
+}
+
+static int vdw_cfs_parse_rate(const char *page, vdw_uio_params *params) {
+	return kstrtou32(page, 0, &params->genrate);
+}
+
+static int vdw_cfs_parse_burst(const char *page, vdw_uio_params *params) {
+	return kstrtou32(page, 0, &params->genburst);
+}
+
+static int vdw_cfs_parse_seqwrite(const char *page, vdw_uio_params *params) {
+	return kstrtobool(page, &params->genseqwrite);
+}
+
+static int vdw_cfs_parse_node(const char *page, vdw_uio_params *params) {
+	return kstrtoint(page, 10, &params->node);
+}
+
+static int vdw_cfs_parse_cpu(const char *page, vdw_uio_params *params) {
+	return kstrtoint(page, 10, &params->cpu);
+}
+
+static int vdw_cfs_parse_capture(const char *page, vdw_uio_params *params) {
+	return simpledriver_parsecapture(page, &params->regs);
+}
+
+static int vdw_cfs_parse_ack(const char *page, vdw_uio_params *params) {
+	return simpledriver_parsereg(page, &params->regs.ackoffset,
+			&params->regs.ackmask);
+}
+
+static int vdw_cfs_parse_pending(const char *page, vdw_uio_params *params) {
+	return simpledriver_parsereg(page, &params->regs.pendingoffset,
+			&params->regs.pendingmask);
+}
+
+static int vdw_cfs_parse_cause(const char *page, vdw_uio_params *params) {
+	return simpledriver_parsereg(page, &params->regs.causeoffset,
+			&params->regs.causemask);
+}
+
+static int vdw_cfs_parse_irqs(const char *page, vdw_uio_params *params) {
+	return simpledriver_parseirqs(page, params);
+}
+
+static int vdw_cfs_parse_maps(const char *page, vdw_uio_params *params) {
+	return simpledriver_parsemaps(page, params);
+}
+
+static int vdw_cfs_parse_snapshot(const char *page, vdw_uio_params *params) {
+	return simpledriver_parsereg(page, &params->snapoffset, &params->snapsize);
+}
+
+static int vdw_cfs_parse_snapus(const char *page, vdw_uio_params *params) {
+	return kstrtou32(page, 0, &params->snapus);
+}
+
+static ssize_t vdw_cfs_irq_show(struct config_item *item, char *page) {
+	return sprintf(page, "%d\n", to_vdw_cfs_inst(item)->params.irq);
+}
+
+static ssize_t vdw_cfs_base_show(struct config_item *item, char *page) {
+	return sprintf(page, "%lx\n",
+			(unsigned long) to_vdw_cfs_inst(item)->params.regstart);
+}
+
+static ssize_t vdw_cfs_size_show(struct config_item *item, char *page) {
+	return sprintf(page, "%u\n", to_vdw_cfs_inst(item)->params.regsize);
+}
+
+static ssize_t vdw_cfs_mode_show(struct config_item *item, char *page) {
+	return sprintf(page, "%s\n",
+			mapmodenames[to_vdw_cfs_inst(item)->params.mapmode]);
+}
+
+static ssize_t vdw_cfs_backend_show(struct config_item *item, char *page) {
+	return sprintf(page, "%s\n",
+			backendnames[to_vdw_cfs_inst(item)->params.backend]);
+}
+
+static ssize_t vdw_cfs_automask_show(struct config_item *item, char *page) {
+	return sprintf(page, "%d\n", to_vdw_cfs_inst(item)->params.automask);
+}
+
+static ssize_t vdw_cfs_rate_show(struct config_item *item, char *page) {
+	return sprintf(page, "%u\n", to_vdw_cfs_inst(item)->params.genrate);
+}
+
+static ssize_t vdw_cfs_burst_show(struct config_item *item, char *page) {
+	return sprintf(page, "%u\n", to_vdw_cfs_inst(item)->params.genburst);
+}
+
+static ssize_t vdw_cfs_seqwrite_show(struct config_item *item, char *page) {
+	return sprintf(page, "%d\n", to_vdw_cfs_inst(item)->params.genseqwrite);
+}
+
+static ssize_t vdw_cfs_node_show(struct config_item *item, char *page) {
+	return sprintf(page, "%d\n", to_vdw_cfs_inst(item)->params.node);
+}
+
+static ssize_t vdw_cfs_cpu_show(struct config_item *item, char *page) {
+	return sprintf(page, "%d\n", to_vdw_cfs_inst(item)->params.cpu);
+}
+
+static ssize_t vdw_cfs_capture_show(struct config_item *item, char *page) {
+	size_t len = vdw_capture_print(page, PAGE_SIZE - 1,
+			&to_vdw_cfs_inst(item)->params.regs);
+	page[len++] = '\n';
+	return len;
+}
+
+static ssize_t vdw_cfs_ack_show(struct config_item *item, char *page) {
+	const vdw_uio_regs *regs = &to_vdw_cfs_inst(item)->params.regs;
+	return sprintf(page, "%x/%x\n", regs->ackoffset, regs->ackmask);
+}
+
+static ssize_t vdw_cfs_pending_show(struct config_item *item, char *page) {
+	const vdw_uio_regs *regs = &to_vdw_cfs_inst(item)->params.regs;
+	return sprintf(page, "%x/%x\n", regs->pendingoffset, regs->pendingmask);
+}
+
+static ssize_t vdw_cfs_cause_show(struct config_item *item, char *page) {
+	const vdw_uio_regs *regs = &to_vdw_cfs_inst(item)->params.regs;
+	return sprintf(page, "%x/%x\n", regs->causeoffset, regs->causemask);
+}
+
+static ssize_t vdw_cfs_irqs_show(struct config_item *item, char *page) {
+	const vdw_uio_params *params = &to_vdw_cfs_inst(item)->params;
+	size_t len = vdw_irqs_print(page, PAGE_SIZE - 1, params->irqs,
+			params->nirqs);
+	page[len++] = '\n';
+	return len;
+}
+
+static ssize_t vdw_cfs_maps_show(struct config_item *item, char *page) {
+	const vdw_uio_params *params = &to_vdw_cfs_inst(item)->params;
+	size_t len = vdw_windows_print(page, PAGE_SIZE - 1, params->windows,
+			params->nwindows);
+	page[len++] = '\n';
+	return len;
+}
+
+static ssize_t vdw_cfs_snapshot_show(struct config_item *item, char *page) {
+	const vdw_uio_params *params = &to_vdw_cfs_inst(item)->params;
+	return sprintf(page, "%x/%x\n", params->snapoffset, params->snapsize);
+}
+
+static ssize_t vdw_cfs_snapus_show(struct config_item *item, char *page) {
+	return sprintf(page, "%u\n", to_vdw_cfs_inst(item)->params.snapus);
+}
+
+/*! id: instance id once committed (uio_vdw_device_<id>), 0 while staged */
+static ssize_t vdw_cfs_id_show(struct config_item *item, char *page) {
+	return sprintf(page, "%u\n", READ_ONCE(to_vdw_cfs_inst(item)->id));
+}
+
+#define VDW_CFS_STORE(_name) \
+static ssize_t vdw_cfs_##_name##_store(struct config_item *item, \
+		const char *page, size_t count) { \
+	return vdw_cfs_store(item, page, count, vdw_cfs_parse_##_name); \
+}
+VDW_CFS_STORE(irq)
+VDW_CFS_STORE(base)
+VDW_CFS_STORE(size)
+VDW_CFS_STORE(mode)
+VDW_CFS_STORE(backend)
+VDW_CFS_STORE(automask)
+VDW_CFS_STORE(rate)
+VDW_CFS_STORE(burst)
+VDW_CFS_STORE(seqwrite)
+VDW_CFS_STORE(node)
+VDW_CFS_STORE(cpu)
+VDW_CFS_STORE(capture)
+VDW_CFS_STORE(ack)
+VDW_CFS_STORE(pending)
+VDW_CFS_STORE(cause)
+VDW_CFS_STORE(irqs)
+VDW_CFS_STORE(maps)
+VDW_CFS_STORE(snapshot)
+VDW_CFS_STORE(snapus)
+
+CONFIGFS_ATTR(vdw_cfs_, irq);
+CONFIGFS_ATTR(vdw_cfs_, base);
+CONFIGFS_ATTR(vdw_cfs_, size);
+CONFIGFS_ATTR(vdw_cfs_, mode);
+CONFIGFS_ATTR(vdw_cfs_, backend);
+CONFIGFS_ATTR(vdw_cfs_, automask);
+CONFIGFS_ATTR(vdw_cfs_, rate);
+CONFIGFS_ATTR(vdw_cfs_, burst);
+CONFIGFS_ATTR(vdw_cfs_, seqwrite);
+CONFIGFS_ATTR(vdw_cfs_, node);
+CONFIGFS_ATTR(vdw_cfs_, cpu);
+CONFIGFS_ATTR(vdw_cfs_, capture);
+CONFIGFS_ATTR(vdw_cfs_, ack);
+CONFIGFS_ATTR(vdw_cfs_, pending);
+CONFIGFS_ATTR(vdw_cfs_, cause);
+CONFIGFS_ATTR(vdw_cfs_, irqs);
+CONFIGFS_ATTR(vdw_cfs_, maps);
+CONFIGFS_ATTR(vdw_cfs_, snapshot);
+CONFIGFS_ATTR(vdw_cfs_, snapus);
+CONFIGFS_ATTR_RO(vdw_cfs_, id);
+
+static struct configfs_attribute *vdw_cfs_inst_attrs[] = {
+	&vdw_cfs_attr_irq,
+	&vdw_cfs_attr_base,
+	&vdw_cfs_attr_size,
+	&vdw_cfs_attr_mode,
+	&vdw_cfs_attr_backend,
+	&vdw_cfs_attr_automask,
+	&vdw_cfs_attr_rate,
+	&vdw_cfs_attr_burst,
+	&vdw_cfs_attr_seqwrite,
+	&vdw_cfs_attr_node,
+	&vdw_cfs_attr_cpu,
+	&vdw_cfs_attr_capture,
+	&vdw_cfs_attr_ack,
+	&vdw_cfs_attr_pending,
+	&vdw_cfs_attr_cause,
+	&vdw_cfs_attr_irqs,
+	&vdw_cfs_attr_maps,
+	&vdw_cfs_attr_snapshot,
+	&vdw_cfs_attr_snapus,
+	&vdw_cfs_attr_id,
+	NULL,
+};
+
+static void vdw_cfs_inst_release(struct config_item *item) {
+	kfree(to_vdw_cfs_inst(item));
+}
+
+static struct configfs_item_operations vdw_cfs_inst_ops = {
+	.release = vdw_cfs_inst_release,
+};
+
+static const struct config_item_type vdw_cfs_inst_type = {
+	.ct_item_ops = &vdw_cfs_inst_ops,
+	.ct_attrs = vdw_cfs_inst_attrs,
+	.ct_owner = THIS_MODULE,
+};
+
+static struct config_item *vdw_cfs_make_item(struct config_group *group,
+		const char *name) {
+	vdw_cfs_inst *inst = kzalloc(sizeof(*inst), GFP_KERNEL);
+	if (!inst) {
+		return ERR_PTR(-ENOMEM);
+	}
+	inst->params.irq = -1;
+	inst->params.regsize = PAGE_SIZE;
+	inst->params.node = NUMA_NO_NODE;
+	inst->params.cpu = -1;
+	config_item_init_type_name(&inst->item, name, &vdw_cfs_inst_type);
+	mutex_lock(&module.lock);
+	list_add_tail(&inst->node, &vdw_cfs_insts);
+	mutex_unlock(&module.lock);
+	return &inst->item;
+}
+
+static void vdw_cfs_drop_item(struct config_group *group,
+		struct config_item *item) {
+	vdw_cfs_inst *inst = to_vdw_cfs_inst(item);
+	vdw_uio_dev_priv_ptr uioinst;
+	mutex_lock(&module.lock);
+	list_del(&inst->node);
+	// only the instance this item created, it may be gone already
+	uioinst = inst->id ? xa_load(&module.instances, inst->id) : 0;
+	if (uioinst && uioinst->ownerid == &inst->id) {
+		simpledriver_instance_remove(inst->id);
+	}
+	mutex_unlock(&module.lock);
+	config_item_put(item);
+}
+
+/* create all staged instances, on the first failure the ones created by
+ * this batch are removed again; called with module.lock held
+ */
+static int vdw_cfs_commit(void) {
+	vdw_cfs_inst *inst;
+	vdw_uio_dev_priv_ptr uioinst;
+	int error = 0;
+	int created = 0;
+
+	list_for_each_entry(inst, &vdw_cfs_insts, node) {
+		if (inst->id) {
+			continue;
+		}
+		error = simpledriver_instance_init(&inst->params, &inst->id);
+		if (error) {
+			printk(KERN_WARNING "commit of %s failed (%d), rolling back\n",
+					config_item_name(&inst->item), error);
+			break;
+		}
+		// the instance zeroes inst->id whenever it is removed
+		uioinst = xa_load(&module.instances, inst->id);
+		uioinst->ownerid = &inst->id;
+		inst->batch = true;
+		++created;
+	}
+	list_for_each_entry(inst, &vdw_cfs_insts, node) {
+		if (inst->batch && error) {
+			simpledriver_instance_remove(inst->id); // clears inst->id
+		}
+		inst->batch = false;
+	}
+	pr_debug("configfs commit, %d instances %s\n", created,
+			error ? "rolled back" : "created");
+	return error;
+}
+
+/*! commit: write 1 to create all staged instances */
+static ssize_t vdw_cfs_commit_store(struct config_item *item,
+		const char *page, size_t count) {
+	bool commit;
+	int ret = kstrtobool(page, &commit);
+	if (ret || !commit) {
+		return ret ? ret : count;
+	}
+	mutex_lock(&module.lock);
+	ret = vdw_cfs_commit();
+	mutex_unlock(&module.lock);
+	return ret ? ret : count;
+}
+
+CONFIGFS_ATTR_WO(vdw_cfs_, commit);
+
+static struct configfs_attribute *vdw_cfs_root_attrs[] = {
+	&vdw_cfs_attr_commit,
+	NULL,
+};
+
+static struct configfs_group_operations vdw_cfs_group_ops = {
+	.make_item = vdw_cfs_make_item,
+	.drop_item = vdw_cfs_drop_item,
+};
+
+static const struct config_item_type vdw_cfs_root_type = {
+	.ct_group_ops = &vdw_cfs_group_ops,
+	.ct_attrs = vdw_cfs_root_attrs,
+	.ct_owner = THIS_MODULE,
+};
+
+static struct configfs_subsystem vdw_cfs_subsys = {
+	.su_group = {
+		.cg_item = {
+			.ci_namebuf = DRV_NAME,
+			.ci_type = &vdw_cfs_root_type,
+		},
+	},
+};
+
+static bool vdw_cfs_registered;
+
+static int vdw_cfs_register(void) {
+	int ret;
+	config_group_init(&vdw_cfs_subsys.su_group);
+	mutex_init(&vdw_cfs_subsys.su_mutex);
+	ret = configfs_register_subsystem(&vdw_cfs_subsys);
+	vdw_cfs_registered = !ret;
+	return ret;
+}
+
+static void vdw_cfs_unregister(void) {
+	if (vdw_cfs_registered) {
+		configfs_unregister_subsystem(&vdw_cfs_subsys);
+	}
+}
+#else
+static int vdw_cfs_register(void) {
+	return 0;
+}
+
+static void vdw_cfs_unregister(void) {
+}
+#endif
+
+/* dma-buf export of kernel allocated instance memory
+ * the instance holds one reference on its memory and every exported
+ * dma-buf another one, so a buffer outlives the removal of its instance
+ */
+static struct sg_table *vdw_dmabuf_map(struct dma_buf_attachment *attach,
+		enum dma_data_direction dir) {
+	vdw_uio_dev_priv_ptr uioinst = attach->dmabuf->priv;
+	struct sg_table *sgt = kzalloc(sizeof(*sgt), GFP_KERNEL);
+	int ret;
+
+	if (!sgt) {
+		return ERR_PTR(-ENOMEM);
+	}
+	// the region is physically contiguous, one entry covers it
+	ret = sg_alloc_table(sgt, 1, GFP_KERNEL);
+	if (ret) {
+		goto fail;
+	}
+	sg_set_page(sgt->sgl, vdw_mem_page(uioinst), uioinst->regsize, 0);
+	ret = dma_map_sgtable(attach->dev, sgt, dir, 0);
+	if (ret) {
+		sg_free_table(sgt);
+		goto fail;
+	}
+	return sgt;
+
+	fail: kfree(sgt);
+	return ERR_PTR(ret);
+}
+
+static void vdw_dmabuf_unmap(struct dma_buf_attachment *attach,
+		struct sg_table *sgt, enum dma_data_direction dir) {
+	dma_unmap_sgtable(attach->dev, sgt, dir, 0);
+	sg_free_table(sgt);
+	kfree(sgt);
+}
+
+/* DMA_BUF_IOCTL_SYNC from userspace ends up here as well */
+static int vdw_dmabuf_begin_cpu(struct dma_buf *dmabuf,
+		enum dma_data_direction dir) {
+	vdw_uio_dev_priv_ptr uioinst = dmabuf->priv;
+	dma_sync_single_for_cpu(&uioinst->dev, uioinst->memdma, uioinst->regsize,
+			dir);
+	return 0;
+}
+
+static int vdw_dmabuf_end_cpu(struct dma_buf *dmabuf,
+		enum dma_data_direction dir) {
+	vdw_uio_dev_priv_ptr uioinst = dmabuf->priv;
+	dma_sync_single_for_device(&uioinst->dev, uioinst->memdma,
+			uioinst->regsize, dir);
+	return 0;
+}
+
+/* same cache attribute as the uio mapping of the region */
+static int vdw_dmabuf_mmap(struct dma_buf *dmabuf, struct vm_area_struct *vma) {
+	vdw_uio_dev_priv_ptr uioinst = dmabuf->priv;
+
+	if (vma->vm_pgoff + vma_pages(vma) > uioinst->regsize >> PAGE_SHIFT) {
+		return -EINVAL;
+	}
+	vma->vm_page_prot = vdw_uio_pgprot(uioinst->mapmode, vma->vm_page_prot);
+	return remap_pfn_range(vma, vma->vm_start,
+			page_to_pfn(vdw_mem_page(uioinst)) + vma->vm_pgoff,
+			vma->vm_end - vma->vm_start, vma->vm_page_prot);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+static int vdw_dmabuf_vmap(struct dma_buf *dmabuf, struct iosys_map *map) {
+	vdw_uio_dev_priv_ptr uioinst = dmabuf->priv;
+	if (!uioinst->memalloc) {
+		return -ENOMEM; // highmem CMA pages
+	}
+	iosys_map_set_vaddr(map, uioinst->memalloc);
+	return 0;
+}
+#endif
+
+static void vdw_dmabuf_release(struct dma_buf *dmabuf) {
+	vdw_uio_dev_priv_ptr uioinst = dmabuf->priv;
+	simpledriver_memput(uioinst);
+	put_device(&uioinst->dev);
+}
+
+static const struct dma_buf_ops vdw_dmabuf_ops = {
+	.map_dma_buf = vdw_dmabuf_map,
+	.unmap_dma_buf = vdw_dmabuf_unmap,
+	.begin_cpu_access = vdw_dmabuf_begin_cpu,
+	.end_cpu_access = vdw_dmabuf_end_cpu,
+	.mmap = vdw_dmabuf_mmap,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+	.vmap = vdw_dmabuf_vmap,
+#endif
+	.release = vdw_dmabuf_release,
+};
+
+/* export the instance memory, called with uioinst->ctllock held
+ * @return the new dma-buf fd or a negative error
+ */
+static int vdw_dmabuf_export(vdw_uio_dev_priv_ptr uioinst, u32 flags) {
+	DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
+	struct dma_buf *dmabuf;
+	dma_addr_t dma;
+	int fd;
+
+	if (!vdw_mem_page(uioinst)) {
+		return -EINVAL; // device memory, nothing to export
+	}
+	/* cpu access sync needs a streaming mapping, cached and contig
+	 * instances have one already
+	 */
+	if (!uioinst->memdma) {
+		dma_set_mask_and_coherent(&uioinst->dev, vdw_mem_dmamask(uioinst));
+		dma = dma_map_single(&uioinst->dev, uioinst->memalloc,
+				uioinst->regsize, DMA_BIDIRECTIONAL);
+		if (dma_mapping_error(&uioinst->dev, dma)) {
+			return -ENOMEM;
+		}
+		uioinst->memdma = dma;
+	}
+
+	exp_info.ops = &vdw_dmabuf_ops;
+	exp_info.size = uioinst->regsize;
+	exp_info.flags = (flags & O_ACCMODE) ? (flags & O_ACCMODE) : O_RDWR;
+	exp_info.priv = uioinst;
+	refcount_inc(&uioinst->memrefs);
+	get_device(&uioinst->dev);
+	dmabuf = dma_buf_export(&exp_info);
+	if (IS_ERR(dmabuf)) {
+		simpledriver_memput(uioinst);
+		put_device(&uioinst->dev);
+		return PTR_ERR(dmabuf);
+	}
+	fd = dma_buf_fd(dmabuf, flags & O_CLOEXEC);
+	if (fd < 0) {
+		dma_buf_put(dmabuf); // release drops the references
+		return fd;
+	}
+	++uioinst->dmabufs;
+	return fd;
+}
+
+/* a replaced list after its grace period, with the eventfd it lost */
+static void vdw_efds_free(struct rcu_head *rcu) {
+	vdw_uio_efds *efds = container_of(rcu, vdw_uio_efds, rcu);
+	if (efds->drop) {
+		eventfd_ctx_put(efds->drop);
+	}
+	kfree(efds);
+}
+
+/* add or remove one eventfd, called with uioinst->ctllock held
+ * the interrupt keeps walking the old list until the grace period ends,
+ * only then are a removed eventfd and the old list released, from an
+ * rcu callback so nobody waits for it under ctllock
+ */
+static int vdw_eventfd_update(vdw_uio_dev_priv_ptr uioinst,
+		const vdw_eventfd_assign *req) {
+	vdw_uio_efds *old = rcu_dereference_protected(uioinst->efds,
+			lockdep_is_held(&uioinst->ctllock));
+	bool deassign = req->flags & VDW_EVENTFD_DEASSIGN;
+	u32 count = old ? old->count : 0;
+	struct eventfd_ctx *drop = NULL;
+	struct eventfd_ctx *ctx;
+	vdw_uio_efds *efds = NULL;
+	u32 iter, kept = 0;
+	int ret = 0;
+
+	if (!deassign && (req->mask & ~uioinst->regs.causemask)) {
+		return -EINVAL; // bits that never come out of the cause register
+	}
+	if (!deassign && (req->lines & ~GENMASK(max(uioinst->nirqs, 1) - 1, 0))) {
+		return -EINVAL; // lines the instance does not have
+	}
+	ctx = eventfd_ctx_fdget(req->fd);
+	if (IS_ERR(ctx)) {
+		return PTR_ERR(ctx);
+	}
+	if (!deassign && count >= VDW_EVENTFDS_MAX) {
+		ret = -ENOSPC;
+		goto exit_func;
+	}
+	if (count + !deassign) {
+		efds = kzalloc(struct_size(efds, entry, count + !deassign), GFP_KERNEL);
+		if (!efds) {
+			ret = -ENOMEM;
+			goto exit_func;
+		}
+	}
+	for (iter = 0; iter < count; iter++) {
+		if (old->entry[iter].ctx != ctx) {
+			efds->entry[kept++] = old->entry[iter];
+		} else if (deassign) {
+			drop = ctx;
+		} else {
+			ret = -EBUSY; // one filter per eventfd
+			goto exit_func;
+		}
+	}
+	if (deassign && !drop) {
+		ret = -ENOENT;
+		goto exit_func;
+	}
+	if (!deassign) {
+		efds->entry[kept].ctx = ctx;
+		efds->entry[kept].mask = req->mask;
+		efds->entry[kept].lines = req->lines;
+		++kept;
+		ctx = NULL; // the list holds the reference now
+	}
+	if (!kept) {
+		kfree(efds);
+		efds = NULL;
+	} else {
+		efds->count = kept;
+	}
+	rcu_assign_pointer(uioinst->efds, efds);
+	efds = NULL;
+	if (old) {
+		old->drop = drop; // only ever set when old had it
+		call_rcu(&old->rcu, vdw_efds_free);
+	}
+
+	exit_func: kfree(efds);
+	if (ctx) {
+		eventfd_ctx_put(ctx);
+	}
+	return ret;
+}
+
+/* /dev/uio_vdw, control device for requests that need a file descriptor
+ * back or hand one in, see uio_vdw.h for the ioctls
+ */
+static long vdw_ctl_ioctl(struct file *file, unsigned int cmd,
+		unsigned long arg) {
+	void __user *argp = (void __user*) arg;
+	vdw_uio_dev_priv_ptr uioinst;
+	vdw_dmabuf_export req;
+	vdw_eventfd_assign efdreq;
+	int ret;
+
+	switch (cmd) {
+	case VDW_IOC_EXPORT_DMABUF:
+		if (copy_from_user(&req, argp, sizeof(req))) {
+			return -EFAULT;
+		}
+		if (req.flags & ~(O_CLOEXEC | O_ACCMODE)) {
+			return -EINVAL;
+		}
+		uioinst = simpledriver_instance_get(req.id);
+		if (!uioinst) {
+			return -ENODEV;
+		}
+		mutex_lock(&uioinst->ctllock);
+		ret = uioinst->ctllive ? vdw_dmabuf_export(uioinst, req.flags) : -ENODEV;
+		mutex_unlock(&uioinst->ctllock);
+		simpledriver_instance_put(uioinst);
+		if (ret < 0) {
+			return ret;
+		}
+		req.fd = ret;
+		return copy_to_user(argp, &req, sizeof(req)) ? -EFAULT : 0;
+	case VDW_IOC_EVENTFD:
+		if (copy_from_user(&efdreq, argp, sizeof(efdreq))) {
+			return -EFAULT;
+		}
+		if (efdreq.flags & ~VDW_EVENTFD_DEASSIGN) {
+			return -EINVAL;
+		}
+		uioinst = simpledriver_instance_get(efdreq.id);
+		if (!uioinst) {
+			return -ENODEV;
+		}
+		mutex_lock(&uioinst->ctllock);
+		ret = uioinst->ctllive ? vdw_eventfd_update(uioinst, &efdreq) : -ENODEV;
+		mutex_unlock(&uioinst->ctllock);
+		simpledriver_instance_put(uioinst);
+		return ret;
+	default:
+		return -ENOTTY;
+	}
+}
+
+static const struct file_operations vdw_ctl_fops = {
+	.owner = THIS_MODULE,
+	.unlocked_ioctl = vdw_ctl_ioctl,
+	// same struct layouts, the argument itself still needs compat_ptr()
+	.compat_ioctl = compat_ptr_ioctl,
+};
+
+static struct miscdevice vdw_ctl_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = DRV_NAME,
+	.fops = &vdw_ctl_fops,
+	.mode = 0600,
+};
+
+static bool vdw_ctl_registered;
+
+static int simpledriver_init(void) {
+	int ret;
+	pr_debug("vdw-driver init\n");
+	mutex_lock(&module.lock);
+	ret = simpledriver_instance_add(devregions);
+	mutex_unlock(&module.lock);
+	// configfs is optional, devadd/devrm keep working without it
+	if (!ret && vdw_cfs_register()) {
+		printk(KERN_WARNING "Failing to register configfs subsystem\n");
+	}
+	// so is the control device, only dma-buf export needs it
+	if (!ret) {
+		vdw_ctl_registered = !misc_register(&vdw_ctl_dev);
+		if (!vdw_ctl_registered) {
+			printk(KERN_WARNING "Failing to register /dev/%s\n", DRV_NAME);
+		}
+	}
+	return ret;
+}
+
+static void simpledriver_exit(void) {
+	vdw_uio_dev_priv_ptr uioinst;
+	unsigned long id;
+	pr_debug("vdw-driver exit begin, %d instances\n", module.instancecount);
+	if (vdw_ctl_registered) {
+		misc_deregister(&vdw_ctl_dev);
+	}
+	vdw_cfs_unregister();
+	mutex_lock(&module.lock);
+	xa_for_each(&module.instances, id, uioinst) {
+		xa_erase(&module.instances, id);
+		simpledriver_instance_destroy(uioinst);
+		--module.instancecount;
+	}
+	mutex_unlock(&module.lock);
+	xa_destroy(&module.instances);
+	rcu_barrier(); // pending vdw_efds_free() callbacks
+	pr_debug("vdw-driver exit done, %d instances\n", module.instancecount);
+}
+
+/* GBO: either use probe or this, not both */
+module_init( simpledriver_init);
+module_exit( simpledriver_exit);
+
+#endif
+
+MODULE_AUTHOR("Gert Boddaert");
+MODULE_DESCRIPTION("Userspace I/O platform driver with IRQ handling for VDW");
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS("platform:" DRV_NAME);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+MODULE_IMPORT_NS("DMA_BUF");
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0)
+MODULE_IMPORT_NS(DMA_BUF);
+#endif
 
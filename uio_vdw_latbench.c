@@ -0,0 +1,385 @@
+/*
+ * uio_vdw_latbench.c
+ *
+ * Interrupt to userspace latency of a uio_vdw instance, driven by the
+ * instance's "trigger" attribute, so no hardware is needed: any instance
+ * with irq -1 (e.g. the default devregions=-1,0,4096) will do.
+ *
+ * A trigger thread raises one event at a time, the main thread waits for
+ * it with the selected strategy and compares the moment it runs with the
+ * timestamp the driver put in the event ring.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <poll.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+
+#include "libuiovdw.h"
+
+#define APP_NAME "uio_vdw_latbench"
+#define APP_VERSION "1.0.0"
+#define UIODEV "/dev/uio"
+#define DRV_DEVICE_NAME "uio_vdw_device"
+
+#define HIST_STEP_NS 10
+#define HIST_BUCKETS 100000 // 10 ns steps up to 1 ms, above goes to max only
+#define WAIT_TIMEOUT_MS 1000
+
+typedef enum _strategy {
+	WAIT_READ = 0, // blocking read()
+	WAIT_POLL, // poll() then read()
+	WAIT_EPOLL, // epoll_wait() then read()
+	WAIT_BUSY, // spin on the event ring counter
+	WAIT_COUNT,
+} strategy;
+
+static const char * const strategynames[] = {
+	[WAIT_READ] = "read",
+	[WAIT_POLL] = "poll",
+	[WAIT_EPOLL] = "epoll",
+	[WAIT_BUSY] = "busy",
+};
+
+typedef struct _histogram {
+	uint64_t *buckets;
+	uint64_t count;
+	uint64_t overflow;
+	uint64_t max;
+	uint64_t sum;
+} histogram;
+
+/* shared between the waiting and the triggering thread */
+typedef struct _bench {
+	vdw_dev *dev;
+	int triggerfd;
+	uint32_t events;
+	int triggercpu;
+	uint32_t acked; // events the waiter has consumed, atomic
+	bool stop; // atomic
+} bench;
+
+static uint64_t nowns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int pincpu(int cpu) {
+	cpu_set_t set;
+	if (cpu < 0) {
+		return 0;
+	}
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void histadd(histogram *hist, uint64_t ns) {
+	uint64_t bucket = ns / HIST_STEP_NS;
+	if (bucket < HIST_BUCKETS) {
+		++hist->buckets[bucket];
+	} else {
+		++hist->overflow;
+	}
+	if (ns > hist->max) {
+		hist->max = ns;
+	}
+	hist->sum += ns;
+	++hist->count;
+}
+
+/* latency at the given fraction of all samples, in ns */
+static double histpercentile(const histogram *hist, double fraction) {
+	uint64_t target = (uint64_t) (fraction * hist->count);
+	uint64_t seen = 0;
+	for (uint64_t iter = 0; iter < HIST_BUCKETS; iter++) {
+		seen += hist->buckets[iter];
+		if (seen > target) {
+			return (double) (iter * HIST_STEP_NS);
+		}
+	}
+	return (double) hist->max;
+}
+
+static void histprint(const histogram *hist, const char *name) {
+	uint64_t log2count[24] = { 0 };
+
+	if (!hist->count) {
+		printf("%-6s no samples\n", name);
+		return;
+	}
+	printf("%-6s n=%llu avg %.2f us p50 %.2f us p99 %.2f us p99.9 %.2f us max %.2f us\n",
+			name, (unsigned long long) hist->count,
+			hist->sum / 1000.0 / hist->count,
+			histpercentile(hist, 0.5) / 1000.0,
+			histpercentile(hist, 0.99) / 1000.0,
+			histpercentile(hist, 0.999) / 1000.0, hist->max / 1000.0);
+
+	/* coarse view: power of 2 microsecond buckets */
+	for (uint64_t iter = 0; iter < HIST_BUCKETS; iter++) {
+		uint64_t us = iter * HIST_STEP_NS / 1000;
+		int slot = 0;
+		while (us) {
+			us >>= 1;
+			++slot;
+		}
+		log2count[slot] += hist->buckets[iter];
+	}
+	for (int iter = 0; iter < 24; iter++) {
+		if (log2count[iter]) {
+			printf("       < %6u us: %llu\n", 1u << iter,
+					(unsigned long long) log2count[iter]);
+		}
+	}
+	if (hist->overflow) {
+		printf("       >= %5u us: %llu\n", HIST_BUCKETS * HIST_STEP_NS / 1000,
+				(unsigned long long) hist->overflow);
+	}
+}
+
+/* raise the next event once the waiter has consumed the previous one */
+static void* triggerthread(void *arg) {
+	bench *b = arg;
+	pincpu(b->triggercpu);
+	for (uint32_t iter = 0; iter < b->events; iter++) {
+		while (__atomic_load_n(&b->acked, __ATOMIC_ACQUIRE) < iter) {
+			if (__atomic_load_n(&b->stop, __ATOMIC_RELAXED)) {
+				return 0;
+			}
+		}
+		while (pwrite(b->triggerfd, "1", 1, 0) < 0) {
+			if (errno != EBUSY) {
+				perror("trigger");
+				__atomic_store_n(&b->stop, true, __ATOMIC_RELAXED);
+				return 0;
+			}
+		}
+	}
+	return 0;
+}
+
+/* wait for the next event with one strategy, 0 on success */
+static int waitevent(bench *b, strategy strat, int epfd,
+		const volatile vdw_uio_eventring *ring, uint64_t lastseq) {
+	uint32_t info;
+	int fd = vdw_fd(b->dev);
+
+	switch (strat) {
+	case WAIT_READ:
+		return read(fd, &info, sizeof(info)) == (ssize_t) sizeof(info) ? 0 : -1;
+	case WAIT_POLL:
+		return vdw_event_wait(b->dev, &info, WAIT_TIMEOUT_MS) == 1 ? 0 : -1;
+	case WAIT_EPOLL: {
+		struct epoll_event event;
+		if (epoll_wait(epfd, &event, 1, WAIT_TIMEOUT_MS) != 1) {
+			return -1;
+		}
+		return vdw_event_try(b->dev, &info) == 1 ? 0 : -1;
+	}
+	case WAIT_BUSY: {
+		uint64_t deadline = nowns() + WAIT_TIMEOUT_MS * 1000000ULL;
+		while (vdw_eventring_counter(ring) == lastseq) {
+			if (nowns() > deadline) {
+				return -1;
+			}
+		}
+		return 0;
+	}
+	default:
+		return -1;
+	}
+}
+
+static int runstrategy(bench *b, strategy strat,
+		const volatile vdw_uio_eventring *ring, histogram *hist) {
+	pthread_t thread;
+	uint32_t info;
+	int epfd = -1;
+	int flags = fcntl(vdw_fd(b->dev), F_GETFL);
+	uint64_t lastseq;
+	int error = 0;
+
+	/* leftovers of an earlier run would satisfy the first wait */
+	fcntl(vdw_fd(b->dev), F_SETFL, flags | O_NONBLOCK);
+	while (vdw_event_try(b->dev, &info) == 1) {
+	}
+	/* the library opens non-blocking, the read strategy wants to sleep */
+	if (strat == WAIT_READ) {
+		fcntl(vdw_fd(b->dev), F_SETFL, flags & ~O_NONBLOCK);
+	}
+	if (strat == WAIT_EPOLL) {
+		struct epoll_event event = { .events = EPOLLIN, };
+		epfd = epoll_create1(EPOLL_CLOEXEC);
+		if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, vdw_fd(b->dev), &event)) {
+			perror("epoll");
+			error = -1;
+			goto exit_run;
+		}
+	}
+
+	memset(hist->buckets, 0, HIST_BUCKETS * sizeof(*hist->buckets));
+	hist->count = hist->overflow = hist->max = hist->sum = 0;
+	b->acked = 0;
+	b->stop = false;
+	lastseq = vdw_eventring_counter(ring);
+	if (pthread_create(&thread, 0, triggerthread, b)) {
+		perror("pthread_create");
+		error = -1;
+		goto exit_run;
+	}
+
+	for (uint32_t iter = 0; iter < b->events; iter++) {
+		uint64_t now;
+		vdw_uio_event event;
+
+		if (waitevent(b, strat, epfd, ring, lastseq)) {
+			fprintf(stderr, "%s: no event after %u of %u\r\n",
+					strategynames[strat], iter, b->events);
+			error = -1;
+			break;
+		}
+		now = nowns();
+		lastseq = vdw_eventring_counter(ring);
+		if (!vdw_eventring_read(ring, lastseq, &event)
+				&& now >= event.timestamp) {
+			histadd(hist, now - event.timestamp);
+		}
+		if (strat == WAIT_BUSY) {
+			vdw_event_try(b->dev, &info); // keep the uio counter drained
+		}
+		__atomic_store_n(&b->acked, iter + 1, __ATOMIC_RELEASE);
+	}
+	__atomic_store_n(&b->stop, true, __ATOMIC_RELAXED);
+	pthread_join(thread, 0);
+
+	exit_run: if (epfd >= 0) {
+		close(epfd);
+	}
+	/* the next strategy, or the caller, finds the mode it started with */
+	fcntl(vdw_fd(b->dev), F_SETFL, flags);
+	return error;
+}
+
+void printhelp() {
+	/* hd:n:s:c:t: */
+	const char *helpstring =
+			APP_NAME " interrupt to userspace latency benchmark\r\n"
+					"options:\r\n"
+					"\th: print this help\r\n"
+					"\td <x>: HEX select /dev/uio<x> instead of the first 'uio_vdw_device' device\r\n"
+					"\tn <x>: DEC x events per strategy (default 1000000)\r\n"
+					"\ts <x>: strategy read, poll, epoll, busy or all (default)\r\n"
+					"\tc <x>: DEC pin the waiting thread to cpu x\r\n"
+					"\tt <x>: DEC pin the triggering thread to cpu x\r\n";
+	fprintf(stderr, "%s", helpstring);
+}
+
+int main(int argc, char *argv[]) {
+	int error = -1;
+	int devsel = -1;
+	int waitcpu = -1;
+	int strat = -1;
+	char path[128];
+	vdw_map ringmap = { 0 };
+	histogram hist = { 0 };
+	bench b = { .triggerfd = -1, .events = 1000000, .triggercpu = -1, };
+	int opt = 0;
+
+	fprintf(stderr, "%s - %s (build %s / %s)\r\n", APP_NAME, APP_VERSION,
+			__DATE__, __TIME__);
+
+	while ((opt = getopt(argc, argv, "hd:n:s:c:t:")) != -1) {
+		switch (opt) {
+		case 'd':
+			devsel = (int) strtol(optarg, NULL, 16);
+			break;
+		case 'n':
+			b.events = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			for (strat = 0; strat < WAIT_COUNT; strat++) {
+				if (!strcmp(optarg, strategynames[strat])) {
+					break;
+				}
+			}
+			if (strat == WAIT_COUNT) {
+				strat = -1;
+			}
+			break;
+		case 'c':
+			waitcpu = atoi(optarg);
+			break;
+		case 't':
+			b.triggercpu = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			printhelp();
+			goto exit_func;
+		}
+	}
+
+	if (devsel < 0) {
+		devsel = vdw_find_nth(DRV_DEVICE_NAME, 0);
+	}
+	if (devsel < 0) {
+		fprintf(stderr, "no %s device found\r\n", DRV_DEVICE_NAME);
+		goto exit_func;
+	}
+	b.dev = vdw_open(devsel);
+	if (!b.dev) {
+		perror("uio open:");
+		goto exit_func;
+	}
+	if (vdw_map_events(b.dev, &ringmap)) {
+		perror("ring mmap:");
+		goto exit_func;
+	}
+	snprintf(path, sizeof(path), "/sys/class/uio/uio%d/device/trigger", devsel);
+	b.triggerfd = open(path, O_WRONLY | O_CLOEXEC);
+	if (b.triggerfd < 0) {
+		perror(path);
+		goto exit_func;
+	}
+	hist.buckets = calloc(HIST_BUCKETS, sizeof(*hist.buckets));
+	if (!hist.buckets) {
+		perror("calloc");
+		goto exit_func;
+	}
+	if (pincpu(waitcpu)) {
+		fprintf(stderr, "cannot pin to cpu %d\r\n", waitcpu);
+	}
+	fprintf(stderr, "%s%d %s, %u events per strategy\r\n", UIODEV, devsel,
+			vdw_name(devsel), b.events);
+
+	error = 0;
+	for (int iter = 0; iter < WAIT_COUNT; iter++) {
+		if (strat >= 0 && iter != strat) {
+			continue;
+		}
+		if (runstrategy(&b, (strategy) iter, ringmap.base, &hist)) {
+			error = -1;
+		}
+		histprint(&hist, strategynames[iter]);
+	}
+
+	exit_func: free(hist.buckets);
+	if (b.triggerfd >= 0) {
+		close(b.triggerfd);
+	}
+	vdw_unmap(&ringmap);
+	vdw_close(b.dev);
+	return error;
+}
@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * uio_vdw_probetest.c
+ *
+ * Userspace IO for Vandewiele
+ *
+ * Probe path test, "make probetest" builds it next to a USE_PROBE=1
+ * uio_vdw, "make probecheck" loads both and runs it. Platform devices
+ * called DRV_NAME bind the same way devicetree nodes do, so every case
+ * registers one with a resource set, waits for the asynchronous probe
+ * and checks the outcome:
+ * - no memory resource: probe fails, no uio device
+ * - two memory resources: bound, one uio device, gone after unregister
+ * - memory plus an interrupt that cannot be requested: probe fails late,
+ *   devm unwinds the uio registration, no uio device is left behind
+ * the memory is a free physical window (nothing is ever accessed there),
+ * found in iomem_resource, or "base=" when the search finds none
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/ioport.h>
+#include <linux/device.h>
+#include <linux/sizes.h>
+
+#define DRV_NAME "uio_vdw"
+#define VDW_TEST_IRQ 0x7ffff // no interrupt controller has it
+
+static ulong base; // 0: search iomem_resource
+module_param(base, ulong, 0444);
+MODULE_PARM_DESC(base, "page aligned physical window of 2 free pages");
+
+static int passed;
+static int failed;
+
+#define VDW_CHECK(_cond, _what) do { \
+	if (_cond) { \
+		++passed; \
+	} else { \
+		++failed; \
+		pr_err("FAIL %s: %s\n", _what, #_cond); \
+	} \
+} while (0)
+
+/* two free pages of physical address space above 4 GB (above RAM on
+ * most machines), released again so the driver can request them
+ */
+static int vdw_test_window(resource_size_t *start) {
+	struct resource probe = { .name = "uio_vdw_probetest",
+			.flags = IORESOURCE_MEM };
+	resource_size_t min = IS_ENABLED(CONFIG_PHYS_ADDR_T_64BIT) ? SZ_4G : SZ_2G;
+	int ret;
+
+	if (base) {
+		*start = base;
+		return 0;
+	}
+	ret = allocate_resource(&iomem_resource, &probe, 2 * PAGE_SIZE, min,
+			iomem_resource.end, PAGE_SIZE, NULL, NULL);
+	if (ret) {
+		pr_err("no free physical window, pass base=\n");
+		return ret;
+	}
+	*start = probe.start;
+	release_resource(&probe);
+	return 0;
+}
+
+static int vdw_test_isuio(struct device *dev, void *data) {
+	return dev->class && !strcmp(dev->class->name, "uio");
+}
+
+static bool vdw_test_bound(struct platform_device *pdev) {
+	bool bound;
+	device_lock(&pdev->dev);
+	bound = pdev->dev.driver != NULL;
+	device_unlock(&pdev->dev);
+	return bound;
+}
+
+/* register DRV_NAME with the resources and let the async probe finish */
+static struct platform_device *vdw_test_add(const struct resource *res,
+		unsigned int nres) {
+	struct platform_device *pdev;
+	pdev = platform_device_register_simple(DRV_NAME, PLATFORM_DEVID_AUTO,
+			res, nres);
+	if (IS_ERR(pdev)) {
+		pr_err("cannot register test device (%ld)\n", PTR_ERR(pdev));
+		++failed;
+		return NULL;
+	}
+	wait_for_device_probe();
+	return pdev;
+}
+
+static void vdw_test_nomem(void) {
+	struct platform_device *pdev = vdw_test_add(NULL, 0);
+	if (!pdev) {
+		return;
+	}
+	VDW_CHECK(!vdw_test_bound(pdev), "no memory resource");
+	VDW_CHECK(!device_for_each_child(&pdev->dev, NULL, vdw_test_isuio),
+			"no memory resource");
+	platform_device_unregister(pdev);
+}
+
+static void vdw_test_maps(resource_size_t start) {
+	struct resource res[] = {
+		DEFINE_RES_MEM(start, PAGE_SIZE),
+		DEFINE_RES_MEM(start + PAGE_SIZE, 0x100),
+	};
+	struct platform_device *pdev = vdw_test_add(res, ARRAY_SIZE(res));
+	if (!pdev) {
+		return;
+	}
+	VDW_CHECK(vdw_test_bound(pdev), "two maps");
+	VDW_CHECK(device_for_each_child(&pdev->dev, NULL, vdw_test_isuio),
+			"two maps");
+	platform_device_unregister(pdev);
+	/* devm released the regions, a second device can take them */
+	pdev = vdw_test_add(res, ARRAY_SIZE(res));
+	if (!pdev) {
+		return;
+	}
+	VDW_CHECK(vdw_test_bound(pdev), "two maps again");
+	platform_device_unregister(pdev);
+}
+
+static void vdw_test_badirq(resource_size_t start) {
+	struct resource res[] = {
+		DEFINE_RES_MEM(start, PAGE_SIZE),
+		DEFINE_RES_IRQ(VDW_TEST_IRQ),
+	};
+	struct platform_device *pdev = vdw_test_add(res, ARRAY_SIZE(res));
+	if (!pdev) {
+		return;
+	}
+	VDW_CHECK(!vdw_test_bound(pdev), "bad irq");
+	VDW_CHECK(!device_for_each_child(&pdev->dev, NULL, vdw_test_isuio),
+			"bad irq");
+	platform_device_unregister(pdev);
+}
+
+static int __init vdw_probetest_init(void) {
+	struct device_driver *drv = driver_find(DRV_NAME, &platform_bus_type);
+	resource_size_t start;
+
+	if (!drv) {
+		pr_err("load " DRV_NAME " built with USE_PROBE=1 first\n");
+		return -ENODEV;
+	}
+	if (vdw_test_window(&start)) {
+		return -ENOSPC;
+	}
+	vdw_test_nomem();
+	vdw_test_maps(start);
+	vdw_test_badirq(start);
+	pr_info("%d passed, %d failed\n", passed, failed);
+	return failed ? -EINVAL : 0;
+}
+
+static void __exit vdw_probetest_exit(void) {
+}
+
+module_init(vdw_probetest_init);
+module_exit(vdw_probetest_exit);
+
+MODULE_AUTHOR("Gert Boddaert");
+MODULE_DESCRIPTION("Probe path test for the uio_vdw platform driver");
+MODULE_LICENSE("GPL v2");
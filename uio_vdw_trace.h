@@ -0,0 +1,168 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * uio_vdw_trace.h
+ *
+ * Userspace IO for Vandewiele
+ *
+ * Tracepoints, /sys/kernel/tracing/events/uio_vdw, usable from perf,
+ * ftrace and bpftrace (tracepoint:uio_vdw:*); durations are only
+ * measured while the event that reports them is enabled
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM uio_vdw
+
+#if !defined(_UIO_VDW_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _UIO_VDW_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* hardirq entry of a driver owned or synthetic interrupt */
+TRACE_EVENT(vdw_irq_entry,
+	TP_PROTO(u32 id, int irq),
+	TP_ARGS(id, irq),
+	TP_STRUCT__entry(
+		__field(u32, id)
+		__field(int, irq)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->irq = irq;
+	),
+	TP_printk("id=%u irq=%d", __entry->id, __entry->irq)
+);
+
+/* handled: IRQ_HANDLED, otherwise declined by the pending check
+ * duration: entry to exit including capture, ack and ring push
+ */
+TRACE_EVENT(vdw_irq_exit,
+	TP_PROTO(u32 id, int irq, bool handled, u64 duration),
+	TP_ARGS(id, irq, handled, duration),
+	TP_STRUCT__entry(
+		__field(u32, id)
+		__field(int, irq)
+		__field(bool, handled)
+		__field(u64, duration)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->irq = irq;
+		__entry->handled = handled;
+		__entry->duration = duration;
+	),
+	TP_printk("id=%u irq=%d handled=%d duration=%lluns", __entry->id,
+			__entry->irq, __entry->handled,
+			(unsigned long long) __entry->duration)
+);
+
+/* events handed to uio_event_notify(), more than 1 when moderated */
+TRACE_EVENT(vdw_notify,
+	TP_PROTO(u32 id, u32 events),
+	TP_ARGS(id, events),
+	TP_STRUCT__entry(
+		__field(u32, id)
+		__field(u32, events)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->events = events;
+	),
+	TP_printk("id=%u events=%u", __entry->id, __entry->events)
+);
+
+/* write() on /dev/uioX, masked is the state afterwards */
+TRACE_EVENT(vdw_irqcontrol,
+	TP_PROTO(u32 id, s32 irq_on, bool masked),
+	TP_ARGS(id, irq_on, masked),
+	TP_STRUCT__entry(
+		__field(u32, id)
+		__field(s32, irq_on)
+		__field(bool, masked)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->irq_on = irq_on;
+		__entry->masked = masked;
+	),
+	TP_printk("id=%u irq_on=%d masked=%d", __entry->id, __entry->irq_on,
+			__entry->masked)
+);
+
+/* mode: vdw_uio_mapmode of the region, -1 for the event ring and the
+ * snapshot page (cacheable kernel pages)
+ */
+TRACE_EVENT(vdw_mmap,
+	TP_PROTO(u32 id, unsigned long map, unsigned long size, int mode,
+			int ret),
+	TP_ARGS(id, map, size, mode, ret),
+	TP_STRUCT__entry(
+		__field(u32, id)
+		__field(unsigned long, map)
+		__field(unsigned long, size)
+		__field(int, mode)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->map = map;
+		__entry->size = size;
+		__entry->mode = mode;
+		__entry->ret = ret;
+	),
+	TP_printk("id=%u map=%lu size=%lu mode=%s ret=%d", __entry->id,
+			__entry->map, __entry->size,
+			__print_symbolic(__entry->mode, { -1, "kernel" }, { 0, "uncached" },
+					{ 1, "cached" }, { 2, "wc" }),
+			__entry->ret)
+);
+
+/* instance_init, id 0 when it failed before an id was allocated */
+TRACE_EVENT(vdw_instance_add,
+	TP_PROTO(u32 id, int irq, unsigned long regstart, u32 regsize,
+			u64 duration, int error),
+	TP_ARGS(id, irq, regstart, regsize, duration, error),
+	TP_STRUCT__entry(
+		__field(u32, id)
+		__field(int, irq)
+		__field(unsigned long, regstart)
+		__field(u32, regsize)
+		__field(u64, duration)
+		__field(int, error)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->irq = irq;
+		__entry->regstart = regstart;
+		__entry->regsize = regsize;
+		__entry->duration = duration;
+		__entry->error = error;
+	),
+	TP_printk("id=%u irq=%d start=%lx size=%u duration=%lluns error=%d",
+			__entry->id, __entry->irq, __entry->regstart, __entry->regsize,
+			(unsigned long long) __entry->duration, __entry->error)
+);
+
+TRACE_EVENT(vdw_instance_remove,
+	TP_PROTO(u32 id, int irq, u64 duration),
+	TP_ARGS(id, irq, duration),
+	TP_STRUCT__entry(
+		__field(u32, id)
+		__field(int, irq)
+		__field(u64, duration)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->irq = irq;
+		__entry->duration = duration;
+	),
+	TP_printk("id=%u irq=%d duration=%lluns", __entry->id, __entry->irq,
+			(unsigned long long) __entry->duration)
+);
+
+#endif /* _UIO_VDW_TRACE_H */
+
+/* outside the guard, read again by define_trace.h */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE uio_vdw_trace
+#include <trace/define_trace.h>
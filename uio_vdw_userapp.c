@@ -16,6 +16,16 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/dma-buf.h>
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+#endif
+
+#include "libuiovdw.h"
 
 #define APP_NAME "simple-uio-user"
 #define APP_VERSION "1.0.0"
@@ -50,40 +60,1377 @@ static const char* readsysparam(const char *strparampath, char *readstr,
 	return retstring;
 }
 
+static double nowsec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* write a cache maintenance request to the instance "sync" attribute,
+ * only valid for instances created with the cached mapping mode
+ */
+static int syncmap(int syncfd, const char *op) {
+	if (syncfd < 0) {
+		return 0;
+	}
+	if (pwrite(syncfd, op, strlen(op), 0) < 0) {
+		perror("sync");
+		return -1;
+	}
+	return 0;
+}
+
+/* memcpy throughput between a local buffer and the mapped region,
+ * cached instances include the flush/invalidate cost in the figures
+ */
+static int memcpybench(int devsel, void *iomem, uint32_t size,
+		uint32_t megabytes) {
+	char fname[256];
+	char mapmode[32] = "uncached";
+	int syncfd = -1;
+	uint32_t passes = 0;
+	double start, elapsed;
+	void *local = malloc(size);
+
+	if (!local) {
+		perror("malloc");
+		return -1;
+	}
+	memset(local, 0x5a, size);
+
+	snprintf(fname, sizeof(fname), "/sys/class/uio/uio%d/device/mapmode", devsel);
+	if (readsysparam(fname, mapmode, sizeof(mapmode))) {
+		mapmode[strcspn(mapmode, "\r\n")] = 0;
+	}
+	if (0 == strcmp(mapmode, "cached")) {
+		snprintf(fname, sizeof(fname), "/sys/class/uio/uio%d/device/sync", devsel);
+		syncfd = open(fname, O_WRONLY);
+		if (syncfd < 0) {
+			perror("open sync");
+		}
+	}
+	passes = (uint32_t)(((uint64_t) megabytes * 1024 * 1024 + size - 1) / size);
+
+	start = nowsec();
+	for (uint32_t iter = 0; iter < passes; iter++) {
+		memcpy(iomem, local, size);
+		syncmap(syncfd, "flush");
+	}
+	elapsed = nowsec() - start;
+	printf("%s write %u x %u bytes: %.1f MB/s\n", mapmode, passes, size,
+			(double) passes * size / elapsed / 1e6);
+
+	start = nowsec();
+	for (uint32_t iter = 0; iter < passes; iter++) {
+		syncmap(syncfd, "invalidate");
+		memcpy(local, iomem, size);
+	}
+	elapsed = nowsec() - start;
+	printf("%s read %u x %u bytes: %.1f MB/s\n", mapmode, passes, size,
+			(double) passes * size / elapsed / 1e6);
+
+	if (syncfd >= 0) {
+		close(syncfd);
+	}
+	free(local);
+	return 0;
+}
+
+/* access pattern sweep over the mapping: every access width, plain
+ * loads/stores, non-temporal stores and memcpy, for a few strides and
+ * block sizes, to pick the access pattern per mapping type
+ * figures count the bytes actually accessed, not the cache lines or bus
+ * transactions behind them, for memcpy one access is a whole block
+ * cached instances are not synced, see -b for figures including that
+ */
+typedef uint64_t (*sweepread_fn)(volatile uint8_t *base, size_t block,
+		size_t stride);
+typedef void (*sweepwrite_fn)(volatile uint8_t *base, size_t block,
+		size_t stride);
+
+typedef long long vec128 __attribute__((vector_size(16)));
+typedef long long vec256 __attribute__((vector_size(32)));
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SWEEP_AVX __attribute__((target("avx")))
+#else
+#define SWEEP_AVX
+#endif
+
+#define SWEEP_SCALAR(_name, _type) \
+static uint64_t _name##_read(volatile uint8_t *base, size_t block, \
+		size_t stride) { \
+	_type sum = 0; \
+	for (size_t off = 0; off + sizeof(_type) <= block; off += stride) { \
+		sum += *(volatile _type*) (base + off); \
+	} \
+	return (uint64_t) sum; \
+} \
+static void _name##_write(volatile uint8_t *base, size_t block, \
+		size_t stride) { \
+	for (size_t off = 0; off + sizeof(_type) <= block; off += stride) { \
+		*(volatile _type*) (base + off) = (_type) off; \
+	} \
+}
+
+#define SWEEP_VECTOR(_name, _type, _attr) \
+_attr static uint64_t _name##_read(volatile uint8_t *base, size_t block, \
+		size_t stride) { \
+	_type sum = { 0 }; \
+	for (size_t off = 0; off + sizeof(_type) <= block; off += stride) { \
+		sum += *(volatile _type*) (base + off); \
+	} \
+	return (uint64_t) sum[0]; \
+} \
+_attr static void _name##_write(volatile uint8_t *base, size_t block, \
+		size_t stride) { \
+	_type value = { 0 }; \
+	for (size_t off = 0; off + sizeof(_type) <= block; off += stride) { \
+		value[0] = off; \
+		*(volatile _type*) (base + off) = value; \
+	} \
+}
+
+SWEEP_SCALAR(sweep8, uint8_t)
+SWEEP_SCALAR(sweep16, uint16_t)
+SWEEP_SCALAR(sweep32, uint32_t)
+SWEEP_SCALAR(sweep64, uint64_t)
+SWEEP_VECTOR(sweep128, vec128, )
+SWEEP_VECTOR(sweep256, vec256, SWEEP_AVX)
+
+#if defined(__x86_64__)
+static void sweepnt128_write(volatile uint8_t *base, size_t block,
+		size_t stride) {
+	for (size_t off = 0; off + 16 <= block; off += stride) {
+		_mm_stream_si128((__m128i*) (base + off), _mm_set1_epi64x(off));
+	}
+	_mm_sfence();
+}
+
+SWEEP_AVX static void sweepnt256_write(volatile uint8_t *base, size_t block,
+		size_t stride) {
+	for (size_t off = 0; off + 32 <= block; off += stride) {
+		_mm256_stream_si256((__m256i*) (base + off), _mm256_set1_epi64x(off));
+	}
+	_mm_sfence();
+}
+#endif
+
+typedef struct _sweepop {
+	const char *name;
+	size_t width; // bytes per access, 0: memcpy of the whole block
+	sweepread_fn read; // 0: no read variant
+	sweepwrite_fn write;
+	bool avx;
+} sweepop;
+
+static const sweepop sweepops[] = {
+	{ "load/store", 1, sweep8_read, sweep8_write, false },
+	{ "load/store", 2, sweep16_read, sweep16_write, false },
+	{ "load/store", 4, sweep32_read, sweep32_write, false },
+	{ "load/store", 8, sweep64_read, sweep64_write, false },
+	{ "simd", 16, sweep128_read, sweep128_write, false },
+	{ "simd", 32, sweep256_read, sweep256_write, true },
+#if defined(__x86_64__)
+	{ "nt-store", 16, 0, sweepnt128_write, false },
+	{ "nt-store", 32, 0, sweepnt256_write, true },
+#endif
+	{ "memcpy", 0, 0, 0, false },
+};
+
+static volatile uint64_t sweepsink; // keeps the loads alive
+
+static int sweepbench(volatile uint8_t *iomem, uint32_t size,
+		uint32_t megabytes) {
+	static const size_t strides[] = { 0, 64, 4096 }; // 0: contiguous
+	static const size_t blocksizes[] = { 4096, 64 * 1024, 1024 * 1024 };
+	size_t blocks[sizeof(blocksizes) / sizeof(blocksizes[0]) + 1];
+	size_t nblocks = 0;
+	uint64_t target = (uint64_t) megabytes * 1024 * 1024;
+	uint8_t *local = malloc(size);
+	bool haveavx = true;
+
+	if (!local) {
+		perror("malloc");
+		return -1;
+	}
+	memset(local, 0x5a, size);
+#if defined(__x86_64__)
+	haveavx = __builtin_cpu_supports("avx");
+#endif
+	for (size_t iter = 0; iter < sizeof(blocksizes) / sizeof(blocksizes[0]); iter++) {
+		if (blocksizes[iter] < size) {
+			blocks[nblocks++] = blocksizes[iter];
+		}
+	}
+	blocks[nblocks++] = size;
+
+	printf("%-10s %4s %5s %6s %9s %9s %10s\n", "op", "bits", "dir", "stride",
+			"block", "GB/s", "ns/access");
+	for (size_t opiter = 0; opiter < sizeof(sweepops) / sizeof(sweepops[0]); opiter++) {
+		const sweepop *op = &sweepops[opiter];
+		if (op->avx && !haveavx) {
+			continue;
+		}
+		for (size_t blockiter = 0; blockiter < nblocks; blockiter++) {
+			size_t block = blocks[blockiter];
+			for (size_t strideiter = 0; strideiter < sizeof(strides) / sizeof(strides[0]); strideiter++) {
+				size_t stride = strides[strideiter] ? strides[strideiter] : op->width;
+				size_t width = op->width ? op->width : block;
+				size_t accesses;
+				uint64_t passes;
+
+				if (strideiter && (!op->width || stride <= op->width
+						|| stride >= block)) {
+					continue; // memcpy is contiguous only
+				}
+				accesses = op->width ? block / stride : 1;
+				passes = target / (accesses * width);
+				passes = passes ? passes : 1;
+
+				for (int write = 0; write < 2; write++) {
+					double start, elapsed;
+					if (op->width && !write && !op->read) {
+						continue;
+					}
+					start = nowsec();
+					for (uint64_t pass = 0; pass < passes; pass++) {
+						if (!op->width) {
+							if (write) {
+								memcpy((uint8_t*) iomem, local, block);
+							} else {
+								memcpy(local, (uint8_t*) iomem, block);
+							}
+						} else if (write) {
+							op->write(iomem, block, stride);
+						} else {
+							sweepsink += op->read(iomem, block, stride);
+						}
+					}
+					elapsed = nowsec() - start;
+					printf("%-10s %4zu %5s %6zu %9zu %9.3f %10.2f\n", op->name,
+							op->width * 8, write ? "write" : "read",
+							op->width ? stride : block, block,
+							(double) passes * accesses * width / elapsed / 1e9,
+							elapsed * 1e9 / ((double) passes * accesses));
+				}
+			}
+		}
+	}
+	free(local);
+	return 0;
+}
+
+/* drain the interrupt event ring without any syscall, spinning on the
+ * ring counter for waitms milliseconds
+ */
+static int ringpoll(vdw_dev *dev, int waitms) {
+	vdw_map ringmap;
+	const volatile vdw_uio_eventring *ring;
+	vdw_uio_event event;
+	uint64_t lastseq, counter;
+	uint64_t received = 0, lost = 0;
+	double end;
+	struct timespec now;
+
+	if (vdw_map_events(dev, &ringmap)) {
+		perror("ring mmap:");
+		return -1;
+	}
+	ring = ringmap.base;
+	if (ring->version != VDW_EVENTRING_VERSION) {
+		fprintf(stderr, "event ring version %u, expected %u\r\n",
+				ring->version, VDW_EVENTRING_VERSION);
+		vdw_unmap(&ringmap);
+		return -1;
+	}
+
+	lastseq = vdw_eventring_counter(ring);
+	end = nowsec() + waitms / 1e3;
+	while (nowsec() < end) {
+		counter = vdw_eventring_counter(ring);
+		if (counter == lastseq) {
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (counter - lastseq > ring->entries) {
+			lost += counter - lastseq - ring->entries;
+			lastseq = counter - ring->entries;
+		}
+		while (lastseq < counter) {
+			++lastseq;
+			if (vdw_eventring_read(ring, lastseq, &event)) {
+				++lost;
+				continue;
+			}
+			++received;
+			printf("#%llu line %u cpu %u latency %lld ns",
+					(unsigned long long) event.seq, event.line, event.cpu,
+					(long long) (now.tv_sec * 1000000000LL + now.tv_nsec)
+					- (long long) event.timestamp);
+			for (uint32_t reg = 0; reg < event.nregs && reg < VDW_EVENT_REGS; reg++) {
+				printf(" %08x", event.regs[reg]);
+			}
+			printf("\n");
+		}
+	}
+	fprintf(stderr, "%llu events, %llu lost\r\n",
+			(unsigned long long) received, (unsigned long long) lost);
+	vdw_unmap(&ringmap);
+	return 0;
+}
+
+/* read the register snapshot page "reads" times, then the same range as
+ * often straight from the mapping, and print the last copy with its age
+ */
+static int snapbench(vdw_dev *dev, const vdw_map *map, uint32_t reads) {
+	vdw_map snapmap;
+	const volatile vdw_uio_snapshot *snap;
+	uint32_t *words;
+	uint64_t retries = 0;
+	__u64 timestamp = 0;
+	uint32_t nwords;
+	double start, snapsec, directsec;
+	struct timespec now;
+
+	if (vdw_map_snapshot(dev, &snapmap)) {
+		perror("snapshot mmap (instance without snapshot=?)");
+		return -1;
+	}
+	snap = snapmap.base;
+	if (snap->version != VDW_SNAPSHOT_VERSION) {
+		fprintf(stderr, "snapshot version %u, expected %u\r\n",
+				snap->version, VDW_SNAPSHOT_VERSION);
+		vdw_unmap(&snapmap);
+		return -1;
+	}
+	nwords = snap->size / 4;
+	words = calloc(nwords, sizeof(*words));
+	if (!words) {
+		vdw_unmap(&snapmap);
+		return -1;
+	}
+
+	start = nowsec();
+	for (uint32_t iter = 0; iter < reads; iter++) {
+		retries += vdw_snapshot_read(snap, words, snap->size, &timestamp);
+	}
+	snapsec = nowsec() - start;
+	start = nowsec();
+	for (uint32_t iter = 0; iter < reads; iter++) {
+		vdw_read_block32(map, snap->offset, words, nwords);
+	}
+	directsec = nowsec() - start;
+
+	vdw_snapshot_read(snap, words, snap->size, &timestamp);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	fprintf(stderr, "%u words at 0x%x: snapshot %.1f ns/read (%llu retries), "
+			"mapping %.1f ns/read, %llu copies taken\r\n", nwords, snap->offset,
+			snapsec * 1e9 / reads, (unsigned long long) retries,
+			directsec * 1e9 / reads, (unsigned long long) snap->count);
+	printf("age %lld ns", (long long) (now.tv_sec * 1000000000LL + now.tv_nsec)
+			- (long long) timestamp);
+	for (uint32_t iter = 0; iter < nwords; iter++) {
+		printf(" %08x", words[iter]);
+	}
+	printf("\n");
+	free(words);
+	vdw_unmap(&snapmap);
+	return 0;
+}
+
+/* one eventfd per bit of mask (mask 0: a single unfiltered one), wait on
+ * all of them for waitms and count the events each cause was woken for
+ */
+static int causewait(vdw_dev *dev, uint32_t mask, int waitms) {
+	struct pollfd fds[33];
+	uint32_t bits[33];
+	uint64_t counts[33] = { 0 };
+	nfds_t nfds = 0;
+	double end;
+	int error = 0;
+
+	for (uint32_t bit = 0; bit < 32; bit++) {
+		if (mask & (1u << bit)) {
+			bits[nfds++] = 1u << bit;
+		}
+	}
+	if (!nfds) {
+		bits[nfds++] = 0;
+	}
+	for (nfds_t iter = 0; iter < nfds; iter++) {
+		fds[iter].fd = vdw_eventfd(dev, bits[iter], 0);
+		fds[iter].events = POLLIN;
+		if (fds[iter].fd < 0) {
+			perror("eventfd (cause= set, mask within it?)");
+			nfds = iter;
+			error = -1;
+			goto exit_func;
+		}
+	}
+	vdw_irq_enable(dev, 1);
+	end = nowsec() + waitms / 1e3;
+	while (nowsec() < end) {
+		int ret = poll(fds, nfds, (int) ((end - nowsec()) * 1e3) + 1);
+		if (ret < 0) {
+			perror("poll()");
+			error = -1;
+			break;
+		}
+		for (nfds_t iter = 0; ret > 0 && iter < nfds; iter++) {
+			uint64_t value;
+			if ((fds[iter].revents & POLLIN)
+					&& read(fds[iter].fd, &value, sizeof(value)) == sizeof(value)) {
+				counts[iter] += value;
+			}
+		}
+		// automask instances stay masked after each event
+		vdw_irq_enable(dev, 1);
+	}
+	for (nfds_t iter = 0; iter < nfds; iter++) {
+		printf("cause %08x: %llu events\n", bits[iter],
+				(unsigned long long) counts[iter]);
+	}
+
+	exit_func: for (nfds_t iter = 0; iter < nfds; iter++) {
+		vdw_eventfd_close(dev, fds[iter].fd);
+	}
+	return error;
+}
+
+/* a whole block through one handle: list the "maps=" windows, then wait
+ * on one eventfd per interrupt line for waitms and count each line
+ */
+static int linewait(vdw_dev *dev, int waitms) {
+	struct pollfd fds[VDW_MAX_LINES];
+	uint64_t counts[VDW_MAX_LINES] = { 0 };
+	int nlines = vdw_lines(dev);
+	int nfds = 0;
+	double end;
+	int error = 0;
+
+	for (int window = 1;; window++) {
+		vdw_map winmap;
+		if (vdw_map_window(dev, window, &winmap)) {
+			break;
+		}
+		fprintf(stderr, "window %d: map %d, %zu bytes at %p\r\n", window,
+				winmap.index, winmap.size, (void*) winmap.base);
+		vdw_unmap(&winmap);
+	}
+	if (nlines < 1 || nlines > VDW_MAX_LINES) {
+		fprintf(stderr, "no interrupt lines\r\n");
+		return -1;
+	}
+	for (nfds = 0; nfds < nlines; nfds++) {
+		fds[nfds].fd = vdw_eventfd(dev, 0, 1u << nfds);
+		fds[nfds].events = POLLIN;
+		if (fds[nfds].fd < 0) {
+			perror("eventfd");
+			error = -1;
+			goto exit_func;
+		}
+	}
+	vdw_irq_enable(dev, 1);
+	end = nowsec() + waitms / 1e3;
+	while (nowsec() < end) {
+		int ret = poll(fds, nfds, (int) ((end - nowsec()) * 1e3) + 1);
+		if (ret < 0) {
+			perror("poll()");
+			error = -1;
+			break;
+		}
+		for (int iter = 0; ret > 0 && iter < nfds; iter++) {
+			uint64_t value;
+			if ((fds[iter].revents & POLLIN)
+					&& read(fds[iter].fd, &value, sizeof(value)) == sizeof(value)) {
+				counts[iter] += value;
+			}
+		}
+		vdw_irq_enable(dev, 1);
+	}
+	for (int iter = 0; iter < nfds; iter++) {
+		printf("line %d: %llu events\n", iter, (unsigned long long) counts[iter]);
+	}
+
+	exit_func: for (int iter = 0; iter < nfds; iter++) {
+		vdw_eventfd_close(dev, fds[iter].fd);
+	}
+	return error;
+}
+
+/* hardirq entries of the instance so far, from its irqstats attribute */
+static int64_t readirqcount(int devsel) {
+	char fname[256];
+	unsigned long long irqs = 0;
+	snprintf(fname, sizeof(fname), "/sys/class/uio/uio%d/device/irqstats", devsel);
+	if (!readsysparam(fname, fname, sizeof(fname))
+			|| sscanf(fname, "irqs %llu", &irqs) != 1) {
+		return -1;
+	}
+	return (int64_t) irqs;
+}
+
+/* service events with the unmask/wait/read protocol and report how many
+ * interrupts reached the cpu for each serviced event, run it once on an
+ * "automask" instance and once on a plain one to compare
+ */
+static int maskbench(int uiofd, int devsel, uint32_t events, int waitms) {
+	char fname[256];
+	uint32_t info;
+	uint32_t serviced = 0;
+	int64_t irqsbefore, irqsafter;
+	struct pollfd fds = { .fd = uiofd, .events = POLLIN, };
+
+	snprintf(fname, sizeof(fname), "/sys/class/uio/uio%d/device/irqstats", devsel);
+	if (readsysparam(fname, fname, sizeof(fname))) {
+		fprintf(stderr, "before: %s", fname);
+	}
+	irqsbefore = readirqcount(devsel);
+	if (irqsbefore < 0) {
+		fprintf(stderr, "no irq statistics on /dev/uio%d\r\n", devsel);
+		return -1;
+	}
+	while (serviced < events) {
+		info = 1;
+		if (write(uiofd, &info, sizeof(info)) != (ssize_t) sizeof(info)) {
+			perror("write (unmask)");
+			return -1;
+		}
+		if (poll(&fds, 1, waitms) < 1) {
+			fprintf(stderr, "timeout after %u events\r\n", serviced);
+			break;
+		}
+		if (read(uiofd, &info, sizeof(info)) != (ssize_t) sizeof(info)) {
+			perror("read()");
+			return -1;
+		}
+		++serviced;
+	}
+	irqsafter = readirqcount(devsel);
+	snprintf(fname, sizeof(fname), "/sys/class/uio/uio%d/device/irqstats", devsel);
+	if (readsysparam(fname, fname, sizeof(fname))) {
+		fprintf(stderr, "after: %s", fname); // notours: declined, not woken
+	}
+	printf("%u events serviced, %lld interrupts, %.2f interrupts/event\n",
+			serviced, (long long) (irqsafter - irqsbefore),
+			serviced ? (double) (irqsafter - irqsbefore) / serviced : 0.0);
+	return 0;
+}
+
+/* soak test against a synthetic (irq -2) instance: service events for a
+ * while with the unmask/wait/read protocol and account for every event
+ * the generator raised, either consumed, coalesced or dropped
+ */
+static int soakbench(vdw_dev *dev, const vdw_map *map, uint32_t seconds) {
+	char stats[256];
+	unsigned long long seqwrite = 0, genseq = 0, gendropped = 0;
+	uint32_t first = 0, last = 0;
+	uint64_t reads = 0, gaps = 0, lastseq = 0;
+	double start, elapsed;
+
+	if (vdw_attr_read(dev, "genstats", stats, sizeof(stats)) < 0) {
+		fprintf(stderr, "/dev/uio%d is no synthetic instance\r\n", vdw_uionr(dev));
+		return -1;
+	}
+	fprintf(stderr, "before: %s\r\n", stats);
+	sscanf(stats, "seq %*u dropped %*u overruns %*u seqwrite %llu", &seqwrite);
+
+	start = nowsec();
+	while (nowsec() - start < seconds) {
+		uint32_t info;
+		vdw_irq_enable(dev, 1);
+		if (vdw_event_wait(dev, &info, 100) != 1) {
+			continue;
+		}
+		if (!reads++) {
+			first = info;
+		}
+		last = info;
+		if (seqwrite) {
+			uint64_t seq = vdw_read64(map, VDW_GEN_SEQ_OFFSET);
+			if (lastseq && seq > lastseq + 1) {
+				gaps += seq - lastseq - 1;
+			}
+			lastseq = seq;
+		}
+	}
+	elapsed = nowsec() - start;
+
+	if (vdw_attr_read(dev, "genstats", stats, sizeof(stats)) >= 0) {
+		fprintf(stderr, "after: %s\r\n", stats);
+		sscanf(stats, "seq %llu dropped %llu", &genseq, &gendropped);
+	}
+	printf("%llu reads in %.2f s, %.0f reads/s, %u events notified\n",
+			(unsigned long long) reads, elapsed, reads / elapsed,
+			reads ? last - first + 1 : 0);
+	printf("generator: %llu events, %llu dropped while masked\n", genseq, gendropped);
+	if (seqwrite) {
+		printf("seq gaps seen by the reader: %llu\n", (unsigned long long) gaps);
+	}
+	return 0;
+}
+
+/* export the instance memory as dma-buf and check that a write through
+ * the uio mapping is visible through the dma-buf mapping, no copy
+ */
+static int dmabufcheck(vdw_dev *dev, const vdw_map *map) {
+	struct dma_buf_sync sync = { 0 };
+	volatile uint32_t *bufmem;
+	uint32_t pattern = (uint32_t) time(NULL);
+	int error = -1;
+	int buffd = vdw_export_dmabuf(dev, O_RDWR | O_CLOEXEC);
+
+	if (buffd < 0) {
+		perror("dma-buf export");
+		return -1;
+	}
+	bufmem = mmap(0, map->size, PROT_READ | PROT_WRITE, MAP_SHARED, buffd, 0);
+	if (bufmem == MAP_FAILED) {
+		perror("dma-buf mmap");
+		close(buffd);
+		return -1;
+	}
+	vdw_write32(map, 0, pattern);
+	sync.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ;
+	ioctl(buffd, DMA_BUF_IOCTL_SYNC, &sync);
+	fprintf(stderr, "dma-buf fd %d: wrote 0x%08x through uio, read 0x%08x\r\n",
+			buffd, pattern, bufmem[0]);
+	if (bufmem[0] == pattern) {
+		error = 0;
+	}
+	sync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ;
+	ioctl(buffd, DMA_BUF_IOCTL_SYNC, &sync);
+	munmap((void*) bufmem, map->size);
+	close(buffd);
+	return error;
+}
+
+#define SCRIPT_OUTBUF (256 * 1024)
+
+/* register offset check for the script ops, word aligned inside the map */
+static bool scriptoffset(const vdw_map *map, uint32_t offset, uint32_t words) {
+	return !(offset & 3) && offset < map->size
+			&& (map->size - offset) / 4 >= words;
+}
+
+/* run a register script against one mapping, from a file or stdin ("-")
+ * one operation per line, values and offsets HEX, times DEC, '#' comments
+ *   r <off> [count]              read, prints "r <off> <value>" per word
+ *   w <off> <value>              write
+ *   m <off> <and> <or>           read-modify-write, prints "m <off> <old> <new>"
+ *   p <off> <mask> <value> <ms>  spin until (reg & mask) == value,
+ *                                prints "p <off> <reg> <spins>"
+ *   i <ms>                       unmask and wait for an interrupt,
+ *                                prints "i <event count>"
+ *   d <us>                       delay
+ * output is buffered and written in one go, a failing p or i stops the
+ * script with "<op> timeout" as its last line
+ */
+static int runscript(vdw_dev *dev, const vdw_map *map, const char *path) {
+	static char outbuf[SCRIPT_OUTBUF];
+	FILE *script = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	char *line = 0;
+	size_t linesize = 0;
+	unsigned lineno = 0, ops = 0;
+	int error = 0;
+	double start;
+
+	if (!script) {
+		perror("script open");
+		return -1;
+	}
+	setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+	start = nowsec();
+	while (!error && getline(&line, &linesize, script) > 0) {
+		char op[4];
+		uint32_t a = 0, b = 0, c = 0, d = 0;
+		int n;
+
+		++lineno;
+		line[strcspn(line, "#\n")] = 0;
+		n = sscanf(line, "%3s %x %x %x %x", op, &a, &b, &c, &d);
+		if (n < 1) {
+			continue; // empty or comment
+		}
+		++ops;
+		if (!strcmp(op, "r") && n >= 2) {
+			uint32_t words = 1;
+			sscanf(line, "%*s %*x %u", &words); // count is DEC
+			if (!scriptoffset(map, a, words)) {
+				goto badoffset;
+			}
+			for (uint32_t iter = 0; iter < words; iter++) {
+				printf("r %x %08x\n", a + iter * 4, vdw_read32(map, a + iter * 4));
+			}
+		} else if (!strcmp(op, "w") && n == 3) {
+			if (!scriptoffset(map, a, 1)) {
+				goto badoffset;
+			}
+			vdw_write32(map, a, b);
+		} else if (!strcmp(op, "m") && n == 4) {
+			uint32_t old;
+			if (!scriptoffset(map, a, 1)) {
+				goto badoffset;
+			}
+			old = vdw_read32(map, a);
+			vdw_write32(map, a, (old & b) | c);
+			printf("m %x %08x %08x\n", a, old, (old & b) | c);
+		} else if (!strcmp(op, "p") && n == 5) {
+			uint64_t spins = 0;
+			uint32_t reg;
+			double end;
+			if (!scriptoffset(map, a, 1)) {
+				goto badoffset;
+			}
+			sscanf(line, "%*s %*x %*x %*x %u", &d); // ms are DEC
+			end = nowsec() + d / 1e3;
+			while (((reg = vdw_read32(map, a)) & b) != c) {
+				if (!(++spins & 1023) && nowsec() > end) {
+					printf("p timeout\n");
+					error = -1;
+					break;
+				}
+			}
+			if (!error) {
+				printf("p %x %08x %llu\n", a, reg, (unsigned long long) spins);
+			}
+		} else if (!strcmp(op, "i") && n == 2) {
+			uint32_t count;
+			sscanf(line, "%*s %u", &a);
+			vdw_irq_enable(dev, 1); // refused without an interrupt line
+			if (vdw_event_wait(dev, &count, (int) a) == 1) {
+				printf("i %u\n", count);
+			} else {
+				printf("i timeout\n");
+				error = -1;
+			}
+		} else if (!strcmp(op, "d") && n == 2) {
+			struct timespec delay;
+			sscanf(line, "%*s %u", &a);
+			delay.tv_sec = a / 1000000;
+			delay.tv_nsec = (a % 1000000) * 1000L;
+			nanosleep(&delay, NULL);
+		} else {
+			fprintf(stderr, "script line %u: cannot parse \"%s\"\r\n", lineno, line);
+			error = -1;
+		}
+		continue;
+badoffset:
+		fprintf(stderr, "script line %u: offset 0x%x outside the map or unaligned\r\n",
+				lineno, a);
+		error = -1;
+	}
+	fflush(stdout);
+	fprintf(stderr, "script: %u operations in %.3f ms%s\r\n", ops,
+			(nowsec() - start) * 1e3, error ? ", stopped" : "");
+	free(line);
+	if (script != stdin) {
+		fclose(script);
+	}
+	return error;
+}
+
+/* one serviced instance of the multi-instance event loop */
+typedef struct _loopdev {
+	vdw_dev *dev;
+	uint32_t info; // read buffer
+	uint32_t unmask; // write buffer, always 1
+	bool irqcontrol; // instance accepts the unmask write
+	uint64_t reads;
+	uint32_t first; // uio event counter of the first read
+	uint32_t last;
+} loopdev;
+
+static void loopdev_event(loopdev *ldev) {
+	if (!ldev->reads++) {
+		ldev->first = ldev->info;
+	}
+	ldev->last = ldev->info;
+}
+
+#ifdef __NR_io_uring_setup
+#define VDW_URING_OP_WRITE 0
+#define VDW_URING_OP_POLL 1
+#define VDW_URING_OP_READ 2
+#define VDW_URING_TIMEOUT (~0ULL)
+#define VDW_URING_TICK_NS 100000000LL
+
+/* just enough of an io_uring to batch the event reads, no liburing */
+typedef struct _uring {
+	int fd;
+	unsigned entries;
+	unsigned *sqhead, *sqtail, *sqmask, *sqarray;
+	unsigned *cqhead, *cqtail, *cqmask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sqring, *cqring;
+	size_t sqringsize, cqringsize, sqessize;
+	unsigned sqlocal; // tail of the sqes queued but not published yet
+	unsigned tosubmit;
+} uring;
+
+static void uring_exit(uring *ring) {
+	if (ring->sqes) {
+		munmap(ring->sqes, ring->sqessize);
+	}
+	if (ring->cqring) {
+		munmap(ring->cqring, ring->cqringsize);
+	}
+	if (ring->sqring) {
+		munmap(ring->sqring, ring->sqringsize);
+	}
+	close(ring->fd);
+}
+
+static int uring_setup(uring *ring, unsigned entries) {
+	struct io_uring_params params;
+	uint8_t *sq, *cq;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&params, 0, sizeof(params));
+	ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0) {
+		return -1;
+	}
+	/* READ/WRITE opcodes came together with fast poll (5.7) */
+	if (!(params.features & IORING_FEAT_FAST_POLL)) {
+		close(ring->fd);
+		errno = ENOSYS;
+		return -1;
+	}
+	ring->entries = params.sq_entries;
+	ring->sqringsize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cqringsize = params.cq_off.cqes
+			+ params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqessize = params.sq_entries * sizeof(struct io_uring_sqe);
+	sq = mmap(0, ring->sqringsize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	cq = mmap(0, ring->cqringsize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = mmap(0, ring->sqessize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	ring->sqring = sq == MAP_FAILED ? 0 : sq;
+	ring->cqring = cq == MAP_FAILED ? 0 : cq;
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = 0;
+	}
+	if (!ring->sqring || !ring->cqring || !ring->sqes) {
+		uring_exit(ring);
+		return -1;
+	}
+	ring->sqhead = (unsigned*) (sq + params.sq_off.head);
+	ring->sqtail = (unsigned*) (sq + params.sq_off.tail);
+	ring->sqmask = (unsigned*) (sq + params.sq_off.ring_mask);
+	ring->sqarray = (unsigned*) (sq + params.sq_off.array);
+	ring->cqhead = (unsigned*) (cq + params.cq_off.head);
+	ring->cqtail = (unsigned*) (cq + params.cq_off.tail);
+	ring->cqmask = (unsigned*) (cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+	ring->sqlocal = *ring->sqtail;
+	return 0;
+}
+
+/* publish queued sqes, then wait for at least mincomplete completions */
+static int uring_enter(uring *ring, unsigned mincomplete) {
+	int ret;
+	__atomic_store_n(ring->sqtail, ring->sqlocal, __ATOMIC_RELEASE);
+	do {
+		ret = (int) syscall(__NR_io_uring_enter, ring->fd, ring->tosubmit,
+				mincomplete, mincomplete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0) {
+		return -1;
+	}
+	ring->tosubmit -= (unsigned) ret;
+	return 0;
+}
+
+static struct io_uring_sqe* uring_sqe(uring *ring) {
+	struct io_uring_sqe *sqe;
+	unsigned index;
+	if (ring->sqlocal - __atomic_load_n(ring->sqhead, __ATOMIC_ACQUIRE)
+			>= ring->entries) {
+		if (uring_enter(ring, 0)
+				|| ring->sqlocal - __atomic_load_n(ring->sqhead, __ATOMIC_ACQUIRE)
+						>= ring->entries) {
+			return 0;
+		}
+	}
+	index = ring->sqlocal & *ring->sqmask;
+	sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sqarray[index] = index;
+	++ring->sqlocal;
+	++ring->tosubmit;
+	return sqe;
+}
+
+/* queue [unmask write ->] poll -> 4 byte read for one instance, linked so
+ * the read only runs once the fd is readable and never blocks
+ */
+static int uring_arm(uring *ring, loopdev *ldevs, unsigned index) {
+	loopdev *ldev = &ldevs[index];
+	int fd = vdw_fd(ldev->dev);
+	struct io_uring_sqe *sqe;
+
+	if (ldev->irqcontrol) {
+		sqe = uring_sqe(ring);
+		if (!sqe) {
+			return -1;
+		}
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->fd = fd;
+		sqe->addr = (uintptr_t) &ldev->unmask;
+		sqe->len = sizeof(ldev->unmask);
+		sqe->flags = IOSQE_IO_LINK;
+		sqe->user_data = ((uint64_t) index << 2) | VDW_URING_OP_WRITE;
+	}
+	sqe = uring_sqe(ring);
+	if (!sqe) {
+		return -1;
+	}
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll_events = POLLIN;
+	sqe->flags = IOSQE_IO_LINK;
+	sqe->user_data = ((uint64_t) index << 2) | VDW_URING_OP_POLL;
+	sqe = uring_sqe(ring);
+	if (!sqe) {
+		return -1;
+	}
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t) &ldev->info;
+	sqe->len = sizeof(ldev->info);
+	sqe->user_data = ((uint64_t) index << 2) | VDW_URING_OP_READ;
+	return 0;
+}
+
+static int uringloop(loopdev *ldevs, unsigned ndev, double endtime) {
+	uring ring;
+	struct __kernel_timespec tick = { .tv_sec = 0, .tv_nsec = VDW_URING_TICK_NS };
+	bool tickarmed = false;
+	unsigned entries = 4;
+	unsigned *rearm;
+	unsigned nrearm;
+
+	/* three sqes per instance plus the tick, capped at the io_uring limit */
+	while (entries < 3 * ndev + 1 && entries < 32768) {
+		entries *= 2;
+	}
+	if (uring_setup(&ring, entries)) {
+		return -1;
+	}
+	rearm = calloc(ndev, sizeof(*rearm));
+	if (!rearm) {
+		uring_exit(&ring);
+		return -1;
+	}
+	for (unsigned iter = 0; iter < ndev; iter++) {
+		if (uring_arm(&ring, ldevs, iter)) {
+			goto fail;
+		}
+	}
+	while (nowsec() < endtime) {
+		unsigned head, tail;
+		if (!tickarmed) {
+			struct io_uring_sqe *sqe = uring_sqe(&ring);
+			if (!sqe) {
+				goto fail;
+			}
+			sqe->opcode = IORING_OP_TIMEOUT;
+			sqe->addr = (uintptr_t) &tick;
+			sqe->len = 1;
+			sqe->user_data = VDW_URING_TIMEOUT;
+			tickarmed = true;
+		}
+		if (uring_enter(&ring, 1)) {
+			goto fail;
+		}
+		/* reap the whole batch, then rearm everything it completed */
+		nrearm = 0;
+		head = *ring.cqhead;
+		tail = __atomic_load_n(ring.cqtail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			const struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cqmask];
+			unsigned index = (unsigned) (cqe->user_data >> 2);
+			if (cqe->user_data == VDW_URING_TIMEOUT) {
+				tickarmed = false;
+				continue;
+			}
+			/* the read ends every chain, also when an earlier link failed */
+			if ((cqe->user_data & 3) != VDW_URING_OP_READ) {
+				continue;
+			}
+			if (cqe->res == (int) sizeof(ldevs[index].info)) {
+				loopdev_event(&ldevs[index]);
+			} else if (cqe->res != -EAGAIN && cqe->res != -ECANCELED) {
+				fprintf(stderr, "%s%d read: %s\r\n", UIODEV,
+						vdw_uionr(ldevs[index].dev), strerror(-cqe->res));
+				continue;
+			}
+			rearm[nrearm++] = index;
+		}
+		__atomic_store_n(ring.cqhead, head, __ATOMIC_RELEASE);
+		for (unsigned iter = 0; iter < nrearm; iter++) {
+			if (uring_arm(&ring, ldevs, rearm[iter])) {
+				goto fail;
+			}
+		}
+	}
+	free(rearm);
+	uring_exit(&ring);
+	return 0;
+
+	fail: perror("io_uring");
+	free(rearm);
+	uring_exit(&ring);
+	return -1;
+}
+#endif
+
+static int epollloop(loopdev *ldevs, unsigned ndev, double endtime) {
+	struct epoll_event events[64];
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		perror("epoll_create1");
+		return -1;
+	}
+	for (unsigned iter = 0; iter < ndev; iter++) {
+		struct epoll_event event = { .events = EPOLLIN, .data.u32 = iter, };
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, vdw_fd(ldevs[iter].dev), &event)) {
+			perror("epoll_ctl");
+			close(epfd);
+			return -1;
+		}
+	}
+	while (nowsec() < endtime) {
+		int n = epoll_wait(epfd, events, sizeof(events) / sizeof(events[0]), 100);
+		if (n < 0 && errno != EINTR) {
+			perror("epoll_wait");
+			break;
+		}
+		for (int iter = 0; iter < n; iter++) {
+			loopdev *ldev = &ldevs[events[iter].data.u32];
+			if (vdw_event_try(ldev->dev, &ldev->info) == 1) {
+				loopdev_event(ldev);
+			}
+			if (ldev->irqcontrol) {
+				vdw_irq_enable(ldev->dev, 1);
+			}
+		}
+	}
+	close(epfd);
+	return 0;
+}
+
+/* service every uio_vdw instance from this one thread for a while and
+ * report the event rate, io_uring when the kernel has it, epoll otherwise
+ */
+static int eventloop(uint32_t seconds, bool forceepoll) {
+	loopdev *ldevs = 0;
+	unsigned ndev = 0;
+	unsigned capacity = 0;
+	uint64_t total = 0;
+	const char *backend = "epoll";
+	double start, elapsed;
+	int uionr;
+	int error = -1;
+
+	if (vdw_discover() < 0) {
+		perror("uio discovery");
+		return -1;
+	}
+	while ((uionr = vdw_find_nth(DRV_DEVICE_NAME, ndev)) >= 0) {
+		if (ndev == capacity) {
+			loopdev *grown;
+			capacity = capacity ? capacity * 2 : 16;
+			grown = realloc(ldevs, capacity * sizeof(*ldevs));
+			if (!grown) {
+				goto exit_loop;
+			}
+			ldevs = grown;
+		}
+		memset(&ldevs[ndev], 0, sizeof(ldevs[ndev]));
+		ldevs[ndev].dev = vdw_open(uionr);
+		if (!ldevs[ndev].dev) {
+			fprintf(stderr, "%s%d: %s\r\n", UIODEV, uionr, strerror(errno));
+			goto exit_loop;
+		}
+		ldevs[ndev].unmask = 1;
+		/* instances without an interrupt line refuse the unmask */
+		ldevs[ndev].irqcontrol = !vdw_irq_enable(ldevs[ndev].dev, 1);
+		++ndev;
+	}
+	if (!ndev) {
+		fprintf(stderr, "no %s device found\r\n", DRV_DEVICE_NAME);
+		goto exit_loop;
+	}
+	fprintf(stderr, "servicing %u instances for %u s\r\n", ndev, seconds);
+
+	start = nowsec();
+#ifdef __NR_io_uring_setup
+	if (!forceepoll) {
+		error = uringloop(ldevs, ndev, start + seconds);
+		if (error) {
+			fprintf(stderr, "io_uring not usable, falling back to epoll\r\n");
+		} else {
+			backend = "io_uring";
+		}
+	}
+#endif
+	if (error) {
+		error = epollloop(ldevs, ndev, start + seconds);
+	}
+	elapsed = nowsec() - start;
+
+	for (unsigned iter = 0; iter < ndev; iter++) {
+		total += ldevs[iter].reads;
+	}
+	printf("%s: %u instances, %llu events in %.2f s, %.0f events/s\n", backend,
+			ndev, (unsigned long long) total, elapsed, total / elapsed);
+	for (unsigned iter = 0; iter < ndev; iter++) {
+		const loopdev *ldev = &ldevs[iter];
+		printf("  %s%d %s: %llu reads, %u interrupts\n", UIODEV,
+				vdw_uionr(ldev->dev), vdw_name(vdw_uionr(ldev->dev)),
+				(unsigned long long) ldev->reads,
+				ldev->reads ? ldev->last - ldev->first + 1 : 0);
+	}
+
+	exit_loop: for (unsigned iter = 0; iter < ndev; iter++) {
+		vdw_close(ldevs[iter].dev);
+	}
+	free(ldevs);
+	return error;
+}
+
+#define SYSPARAMS "/sys/module/" DRV_NAME "/parameters/"
+#define BULK_LISTMAX 3968 // devrm writes stay below a page
+
+/* write value to the module parameter param, -1 on error */
+static int writesysparam(const char *param, const char *value) {
+	char path[256];
+	int fd;
+	ssize_t r;
+	snprintf(path, sizeof(path), SYSPARAMS "%s", param);
+	fd = open(path, O_WRONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	r = write(fd, value, strlen(value));
+	if (r < 0) {
+		perror(path);
+	}
+	close(fd);
+	return r < 0 ? -1 : 0;
+}
+
+/* registry ids of the instances present at one moment, sorted */
+typedef struct {
+	uint32_t *ids;
+	size_t count;
+	size_t capacity;
+} bulkset;
+
+static int bulkcmp(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+	return x < y ? -1 : x > y;
+}
+
+/* collect the registry ids of the instances present now, ids are handed
+ * out cyclically so any 31-bit value can show up
+ */
+static int bulkids(bulkset *set) {
+	char fname[256];
+	int uionr, nth = 0;
+	long id;
+	set->count = 0;
+	if (vdw_discover() < 0) {
+		perror("uio discovery");
+		return -1;
+	}
+	while ((uionr = vdw_find_nth(DRV_DEVICE_NAME, nth++)) >= 0) {
+		snprintf(fname, sizeof(fname), "/sys/class/uio/uio%d/device/id", uionr);
+		if (!readsysparam(fname, fname, sizeof(fname))) {
+			continue;
+		}
+		id = strtol(fname, NULL, 10);
+		if (id <= 0 || id > INT32_MAX) {
+			continue;
+		}
+		if (set->count == set->capacity) {
+			size_t capacity = set->capacity ? 2 * set->capacity : 256;
+			uint32_t *grown = realloc(set->ids, capacity * sizeof(*grown));
+			if (!grown) {
+				perror("realloc");
+				return -1;
+			}
+			set->ids = grown;
+			set->capacity = capacity;
+		}
+		set->ids[set->count++] = (uint32_t) id;
+	}
+	if (set->count) {
+		qsort(set->ids, set->count, sizeof(*set->ids), bulkcmp);
+	}
+	return 0;
+}
+
+/* remove the instances in created that are not in before with as few
+ * devrm writes as the id ranges allow, a range only spans ids that are
+ * all ours
+ * @return instances removed, -1 on error
+ */
+static int bulkremove(const bulkset *before, const bulkset *created) {
+	char list[BULK_LISTMAX + 32];
+	size_t len = 0;
+	int removed = 0;
+	uint32_t first = 0, last = 0; // 0: no open range
+	for (size_t iter = 0; iter <= created->count; iter++) {
+		uint32_t id = iter < created->count ? created->ids[iter] : 0;
+		if (id && before->count && bsearch(&id, before->ids, before->count,
+				sizeof(*before->ids), bulkcmp)) {
+			id = 0;
+		}
+		if (id && first && id == last + 1) {
+			last = id;
+			++removed;
+			continue;
+		}
+		if (first) {
+			len += snprintf(list + len, sizeof(list) - len, "%s%u-%u",
+					len ? "," : "", first, last);
+			if (len >= BULK_LISTMAX) {
+				if (writesysparam("devrm", list)) {
+					return -1;
+				}
+				len = 0;
+			}
+		}
+		first = last = id;
+		removed += id ? 1 : 0;
+	}
+	if (len && writesysparam("devrm", list)) {
+		return -1;
+	}
+	return removed;
+}
+
+/* time creating and removing 1, 100 and 1000 (up to max) memory backed
+ * instances, each size as one devadd "count=" write and one batched
+ * devrm, discovery in between is not timed; needs root
+ */
+static int bulkbench(uint32_t max) {
+	static const uint32_t sizes[] = { 1, 100, 1000 };
+	bulkset before = { 0 };
+	bulkset after = { 0 };
+	char entry[64];
+	double start, created, removed;
+	int found;
+	int error = -1;
+
+	for (unsigned iter = 0; iter < sizeof(sizes) / sizeof(sizes[0]); iter++) {
+		uint32_t count = sizes[iter];
+		if (count > max) {
+			break;
+		}
+		if (bulkids(&before)) {
+			goto exit_bulk;
+		}
+		snprintf(entry, sizeof(entry), "-1,0,4096:count=%u", count);
+		start = nowsec();
+		error = writesysparam("devadd", entry);
+		created = nowsec() - start;
+		// a failed devadd creates nothing, remove whatever is new anyway
+		if (bulkids(&after)) {
+			error = -1;
+			goto exit_bulk;
+		}
+		start = nowsec();
+		found = bulkremove(&before, &after);
+		removed = nowsec() - start;
+		if (error || found != (int) count) {
+			fprintf(stderr, "%u instances requested, %d created\r\n", count,
+					found);
+			error = -1;
+			goto exit_bulk;
+		}
+		printf("%5u instances: create %9.3f ms (%7.1f us each), remove %9.3f ms "
+				"(%7.1f us each)\n", count, created * 1e3, created * 1e6 / count,
+				removed * 1e3, removed * 1e6 / count);
+	}
+	error = 0;
+
+	exit_bulk: free(before.ids);
+	free(after.ids);
+	return error;
+}
+
 void printhelp() {
-	/* hi:o:w:c:d: */
+	/* hi:o:w:c:d:b:B:rm:a:Es:DS:n:F:LI: */
 	const char *helpstring =
 			"uio_vdw_user test program\r\n"
+					"by default unmasks, waits -i ms for an interrupt, then reads (or writes) -c registers at -o\r\n"
 					"options:\r\n"
 					"\th: print this help\r\n"
-					"\ti <x>: DEC x milliseconds to wait for interrupt\r\n"
+					"\ti <x>: DEC x milliseconds to wait for interrupt (also the run time of -r, -F and -L, the poll timeout of -m)\r\n"
 					"\to <x>: HEX offset x from start mmap (please align on 32-bit)\r\n"
 					"\tw <x>: HEX x = value to write, without -w option, only read\r\n"
 					"\tc <x>: DEC x = number of incremental address iterations\r\n"
-					"\td <x>: HEX select /dev/uio<x> instead of looping to find first 'vdw_uio_device' device\r\n";
+					"\td <x>: HEX select /dev/uio<x> instead of the first '" DRV_DEVICE_NAME "' device the library discovers\r\n"
+					"modes, the first one given runs, uio map 0 of the selected device unless noted:\r\n"
+					"\ta <x>: DEC service all instances from one thread for x seconds and report events/s (no -d)\r\n"
+					"\tE: with -a, use epoll instead of io_uring\r\n"
+					"\tI <x>: DEC time bulk creation and removal of 1, 100 and 1000 instances, those up to x (no -d, needs root)\r\n"
+					"\tS <file>: run the register script in file ('-' for stdin) against the mapping\r\n"
+					"\tn <x>: DEC read the register snapshot page x times, compare with reading the mapping\r\n"
+					"\tb <x>: DEC x MiB memcpy throughput benchmark in both directions over the mapping\r\n"
+					"\tB <x>: DEC access pattern sweep (width, direction, stride, block, nt-store, memcpy), x MiB per figure\r\n"
+					"\tD: export the region as dma-buf and check it shares the uio mapping\r\n"
+					"\ts <x>: DEC soak test a synthetic (irq -2) instance for x seconds, account for dropped events\r\n"
+					"\tm <x>: DEC service x events (unmask, poll, read) and report interrupts per event\r\n"
+					"\tL: list the maps= windows, count events per interrupt line for the -i time\r\n"
+					"\tF <x>: HEX one eventfd per cause bit of x (0: one for every event), count events for the -i time\r\n"
+					"\tr: busy-poll the event ring for the -i time instead of poll()/read(), prints captured registers\r\n";
 	fprintf(stderr, "%s", helpstring);
 }
 
 int main(int argc, char *argv[]) {
 	int error = -1;
 	int uiofd = -1;
-	int deviter = 0;
-	uint32_t PAGE_SIZE = sysconf(_SC_PAGESIZE);
+	vdw_dev *dev = 0;
+	vdw_map iomap = { 0 };
 	uint32_t size = 0;
 	uint32_t *iomem = (uint32_t*) -1;
-	char fname[256];
 	int waitinttime = 0;
 	uint32_t offset = 0;
 	uint32_t writeval = 0;
 	bool writeop = false;
 	uint32_t count = 1;
 	int devsel = -1;
+	uint32_t benchmb = 0;
+	uint32_t sweepmb = 0;
+	bool ringmode = false;
+	uint32_t maskevents = 0;
+	uint32_t loopseconds = 0;
+	bool forceepoll = false;
+	uint32_t soakseconds = 0;
+	bool dmabuf = false;
+	const char *scriptpath = 0;
+	uint32_t snapreads = 0;
+	bool causemode = false;
+	uint32_t causemask = 0;
+	bool linemode = false;
+	uint32_t bulkmax = 0;
 	int opt = 0;
 
 	fprintf(stderr, "%s - %s (build %s / %s)\r\n", APP_NAME, APP_VERSION,
 			__DATE__, __TIME__);
 
-	while ((opt = getopt(argc, argv, "hi:o:w:c:d:")) != -1) {
+	while ((opt = getopt(argc, argv, "hi:o:w:c:d:b:B:rm:a:Es:DS:n:F:LI:")) != -1) {
 		switch (opt) {
 		case 'i':
 			waitinttime = atoi(optarg);
@@ -100,7 +1447,46 @@ int main(int argc, char *argv[]) {
 			break;
 		case 'd':
 			devsel = (int) strtol(optarg, NULL, 16);
-			deviter = devsel;
+			break;
+		case 'b':
+			benchmb = strtol(optarg, NULL, 10);
+			break;
+		case 'B':
+			sweepmb = strtol(optarg, NULL, 10);
+			break;
+		case 'r':
+			ringmode = true;
+			break;
+		case 'm':
+			maskevents = strtol(optarg, NULL, 10);
+			break;
+		case 'a':
+			loopseconds = strtol(optarg, NULL, 10);
+			break;
+		case 'E':
+			forceepoll = true;
+			break;
+		case 's':
+			soakseconds = strtol(optarg, NULL, 10);
+			break;
+		case 'D':
+			dmabuf = true;
+			break;
+		case 'S':
+			scriptpath = optarg;
+			break;
+		case 'n':
+			snapreads = strtol(optarg, NULL, 10);
+			break;
+		case 'F':
+			causemode = true;
+			causemask = strtoul(optarg, NULL, 16);
+			break;
+		case 'L':
+			linemode = true;
+			break;
+		case 'I':
+			bulkmax = strtoul(optarg, NULL, 10);
 			break;
 		default: // intentional fall through
 			fprintf(stderr, "\r\nInvalid option received\r\n");
@@ -110,72 +1496,107 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	// find the right /dev/uioX ...
-	do {
-		snprintf(fname, sizeof(fname), "/sys/class/uio/uio%d/name", deviter);
-		if (readsysparam(fname, fname, sizeof(fname))) {
-			fprintf(stderr,
-					"check using %s%d name \"%s\" with uio provided name: %s",
-					UIODEV, deviter, DRV_DEVICE_NAME, fname);
-			if (0 == strncmp(DRV_DEVICE_NAME, fname, strlen(DRV_DEVICE_NAME))) {
-				fprintf(stderr, "check mapsize %s%d\r\n", UIODEV, deviter);
-				snprintf(fname, sizeof(fname),
-						"/sys/class/uio/uio%d/maps/map0/size", deviter);
-				if (readsysparam(fname, fname, sizeof(fname))) {
-					size = strtol(fname, NULL, 16);
-					fprintf(stderr, "to be mapped size = %u\r\n", size);
-					devsel = deviter;
-				}
-				if (!size) {
-					fprintf(stderr, "Failed to get mapped size\r\n");
-				} else {
-					break;
-				}
-			}
-		}
-		if (devsel > 0)
-			break;
-		++deviter;
-	} while (deviter < 10);
+	if (loopseconds) {
+		error = eventloop(loopseconds, forceepoll);
+		goto exit_func;
+	}
+
+	if (bulkmax) {
+		error = bulkbench(bulkmax);
+		goto exit_func;
+	}
 
-	if (deviter >= 10 || !size) {
+	// find the right /dev/uioX ...
+	if (devsel < 0) {
+		devsel = vdw_find_nth(DRV_DEVICE_NAME, 0);
+	}
+	if (devsel < 0 || !vdw_name(devsel)) {
+		fprintf(stderr, "no %s device found\r\n", DRV_DEVICE_NAME);
 		goto exit_func;
 	}
+	fprintf(stderr, "using %s%d with uio provided name: %s\r\n", UIODEV,
+			devsel, vdw_name(devsel));
 
 	fprintf(stderr, "%s operation on /dev/uio%d at offset 0x%08x count %u\r\n",
 			writeop ? "write" : "read", devsel, offset, count);
 
-	snprintf(fname, sizeof(fname), "%s%d", UIODEV, deviter);
-	uiofd = open(fname, O_RDWR);
-	if (uiofd < 0) {
+	dev = vdw_open(devsel);
+	if (!dev) {
 		perror("uio open:");
 		error = errno;
 		goto exit_func;
 	}
+	uiofd = vdw_fd(dev);
 
-	fprintf(stderr, "%s opened\r\n", fname);
-
-	iomem = (uint32_t*) mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, uiofd,
-			0 * PAGE_SIZE);
-	fprintf(stderr, "%s mapped at %p\r\n", fname, iomem);
-
-	if ((uintptr_t) iomem == (uintptr_t) -1) {
+	if (vdw_map_region(dev, 0, &iomap)) {
 		perror("uio mmap:");
 		error = errno;
 		goto exit_func;
 	}
+	iomem = (uint32_t*) iomap.base;
+	size = iomap.size;
+	fprintf(stderr, "%s%d mapped %u bytes at %p\r\n", UIODEV, devsel, size, iomem);
+
+	if (scriptpath) {
+		error = runscript(dev, &iomap, scriptpath);
+		goto exit_func;
+	}
+
+	if (snapreads) {
+		error = snapbench(dev, &iomap, snapreads);
+		goto exit_func;
+	}
+
+	if (benchmb) {
+		error = memcpybench(devsel, iomem, size, benchmb);
+		goto exit_func;
+	}
+
+	if (sweepmb) {
+		error = sweepbench(iomap.base, size, sweepmb);
+		goto exit_func;
+	}
+
+	if (dmabuf) {
+		error = dmabufcheck(dev, &iomap);
+		goto exit_func;
+	}
+
+	if (soakseconds) {
+		error = soakbench(dev, &iomap, soakseconds);
+		goto exit_func;
+	}
+
+	if (maskevents) {
+		error = maskbench(uiofd, devsel, maskevents,
+				waitinttime ? waitinttime : 1000);
+		goto exit_func;
+	}
+
+	if (linemode) {
+		error = linewait(dev, waitinttime);
+		goto exit_func;
+	}
+
+	if (causemode) {
+		error = causewait(dev, causemask, waitinttime);
+		goto exit_func;
+	}
+
+	if (ringmode) {
+		error = ringpoll(dev, waitinttime);
+		goto exit_func;
+	}
 
 	fprintf(stderr, "waiting for interrupt %d ms\r\n", waitinttime);
 	ssize_t nb = -1;
 	struct pollfd fds = { .fd = uiofd, .events = POLLIN, };
 	uint32_t info = 1; /* unmask */
-#if 0 /* write not implemented in custom uio driver, but in uio_pdrv_genirq it is */
+	/* instances without an interrupt line refuse the unmask, harmless */
 	nb = write(uiofd, &info, sizeof(info));
 	if (nb != (ssize_t)sizeof(info)) {
-		perror("write");
-		goto exit_func;
+		perror("write (unmask)");
 	}
-#endif
 
 	int ret = poll(&fds, 1, waitinttime);
 	if (ret >= 1) {
@@ -203,14 +1624,14 @@ int main(int argc, char *argv[]) {
 		++iomem_iter;
 	}
 
-	exit_func: if ((uintptr_t) iomem != (uintptr_t) -1) {
-		munmap(iomem, size);
-		fprintf(stderr, "%s unmapped\r\n", fname);
+	exit_func: if (iomap.base) {
+		vdw_unmap(&iomap);
+		fprintf(stderr, "%s%d unmapped\r\n", UIODEV, devsel);
 	}
 
-	if (uiofd >= 0) {
-		close(uiofd);
-		fprintf(stderr, "%s closed\r\n", fname);
+	if (dev) {
+		vdw_close(dev);
+		fprintf(stderr, "%s%d closed\r\n", UIODEV, devsel);
 	}
 
 	return error;